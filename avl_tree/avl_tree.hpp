@@ -1,14 +1,22 @@
 #ifndef AVL_TREE_H_
 #define AVL_TREE_H_
 
+#include <memory>
+#include <type_traits>
 #include <utility>  
 #include <iostream>  
 #include <stack>
 #include <cassert>  
+#include <cstddef>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "../pool_allocator/pool_allocator.hpp"
 
 namespace dicts {
 
-template<typename K, typename V> 
+template<typename K, typename V, typename A = std::allocator<std::pair<const K, V> > >
 class AVLDict {
 	private:
 		struct Node; //Forward declaration
@@ -46,22 +54,87 @@ class AVLDict {
 			private:
 				Node* current;
 				Node* prev;
+				
+			friend class AVLDict;
 		};
 		
 		
 		AVLDict();
 		
+		// nodes are allocated with alloc, e.g. a PoolAllocator
+		explicit AVLDict(const A& alloc);
+		
 		AVLDict(const AVLDict& bst);
 		
+		// takes the nodes of bst, which is left empty
+		AVLDict(AVLDict&& bst);
+		
 		~AVLDict();
 		
+		// Builds a balanced tree out of the (key, value) pairs in [first, last),
+		// whose keys must be strictly increasing, in O(n). The nodes are
+		// allocated in key order, so that they end up next to each other.
+		template<typename ForwardIt>
+		static AVLDict from_sorted(ForwardIt first, ForwardIt last, const A& alloc = A());
+		
+		template<typename Range>
+		static AVLDict from_sorted(const Range& range, const A& alloc = A());
+		
 		bool exists(const K& key) const;
 		
 		V& get(const K& key);
 		
 		void set(const K& key, const V& val);
 		
+		// set() that tells where the entry is and whether it is new
+		std::pair<ConstIterator, bool> insert_or_assign(const K& key, const V& val);
+		
+		// inserts key with a value made from args, unless it is there already
+		template<typename... Args>
+		std::pair<ConstIterator, bool> try_emplace(const K& key, Args&&... args);
+		
+		// try_emplace() without a search when key goes after every key in
+		// the dict and hint is end() or the last entry, as when the keys
+		// come sorted: O(1) amortized rebalancing, but O(log n) to count
+		// the new node in the sizes of its ancestors. A plain insert
+		// otherwise.
+		ConstIterator insert(ConstIterator hint, const K& key, const V& val);
+		
 		void erase(const K& key);
+		
+		size_t size() const;
+		
+		// entry with the k-th smallest key, counting from 0, or end()
+		ConstIterator select(size_t k);
+		
+		// number of keys below key
+		size_t rank(const K& key) const;
+		
+		// number of keys in [lo, hi)
+		size_t count_range(const K& lo, const K& hi) const;
+		
+		// The set operations take the nodes of other, which is left empty,
+		// and split and join subtrees instead of inserting entries one by
+		// one: O(m log(n/m + 1)) for sizes m <= n, against O(m log(n + m)).
+		// With threads > 1 the two halves of the recursion run on separate
+		// threads while both have enough nodes.
+		
+		// adds the entries of other, its values win for the keys in both
+		void union_with(AVLDict& other, unsigned threads = 1);
+		
+		// keeps the entries whose keys are in other
+		void intersect_with(AVLDict& other, unsigned threads = 1);
+		
+		// drops the entries whose keys are in other
+		void difference(AVLDict& other, unsigned threads = 1);
+		
+		// moves the entries with keys not below key to the returned dict,
+		// in O(log n)
+		AVLDict split(const K& key);
+		
+		// moves in the entries of right, whose keys must all be above the
+		// keys here, in O(log n)
+		void join(AVLDict& right);
 
 		AVLDict& operator= (const AVLDict& bst);
 		
@@ -69,11 +142,29 @@ class AVLDict {
 		
 		ConstIterator end();
 		
+		// first entry whose key is not below key, or end()
+		ConstIterator lower_bound(const K& key);
+		
+		// first entry whose key is above key, or end()
+		ConstIterator upper_bound(const K& key);
+		
+		std::pair<ConstIterator, ConstIterator> equal_range(const K& key);
+		
+		// Calls fn(key, val) on the entries with lo <= key < hi in key order
+		// until fn returns false. The tree is balanced, so the descent to lo
+		// and the k entries after it, streamed off a stack, cost O(log n + k)
+		// node visits.
+		template<typename F>
+		void for_each_in_range(const K& lo, const K& hi, F fn);
+		
 
 	private: 
 		struct Node {
 			int height;
 			
+			// nodes in the subtree, this one included
+			size_t size;
+			
 			K key;
 			V val;
 			
@@ -83,6 +174,7 @@ class AVLDict {
 			
 			Node(Node* p, const K& k, const V& v) {
 				height = 1;
+				size = 1;
 
 				key = k; 
 				val = v;
@@ -92,14 +184,18 @@ class AVLDict {
 				right   = nullptr;
 			}
 			
+			// and the size
 			void update_height() {
 				int rh = 0, lh = 0;
+				size = 1;
 		
 				if (right != nullptr) {
 					rh = right->height;
+					size += right->size;
 				} 
 				if (left != nullptr) {
 					lh = left->height;
+					size += left->size;
 				}
 				
 				height = std::max(lh, rh) + 1;
@@ -124,6 +220,16 @@ class AVLDict {
 		
 		Node* findNode(Node* subtree, const K& key) const; 
 		
+		Node* lowerNode(const K& key) const;
+		
+		Node* upperNode(const K& key) const;
+		
+		Node* findLink(const K& key, Node*& parent, Node**& link);
+		
+		Node* link_node(Node* parent, Node** link, const K& key, const V& val);
+		
+		void insert_fixup(Node* node);
+		
 		void rebalance(Node* curr_node);
 		
 		void recalculate_height(Node* curr_node);
@@ -135,11 +241,47 @@ class AVLDict {
 		void leftRotate(Node* n);
 		
 		bool sideOfChild(Node* subtree, bool zag1, bool zag2) const;
-				
-		Node* set(Node*& subtree, Node* parent, const K& key, const V& val);
 		
 		static Node* subtreeMin(Node* subtree);
 		
+		static size_t subtreeSize(Node* subtree);
+		
+		static int heightOf(Node* subtree);
+		
+		static Node* detach(Node* subtree);
+		
+		Node* joinNodes(Node* left, Node* middle, Node* right);
+		
+		Node* joinRight(Node* left, Node* middle, Node* right);
+		
+		Node* joinLeft(Node* left, Node* middle, Node* right);
+		
+		Node* concatNodes(Node* left, Node* right);
+		
+		Node* splitNodes(Node* subtree, const K& key, Node*& left, Node*& right);
+		
+		Node* unionNodes(Node* t1, Node* t2, std::vector<Node*>* dropped, unsigned threads);
+		
+		Node* intersectNodes(Node* t1, Node* t2, std::vector<Node*>* dropped, unsigned threads);
+		
+		Node* differenceNodes(Node* t1, Node* t2, std::vector<Node*>* dropped, unsigned threads);
+		
+		typedef Node* (AVLDict::*SetOp)(Node*, Node*, std::vector<Node*>*, unsigned);
+		
+		void forkJoin(SetOp op, Node* l1, Node* l2, Node*& left, Node* r1, Node* r2, Node*& right,
+		              std::vector<Node*>* dropped, unsigned threads);
+		
+		static void dropSubtree(Node* subtree, std::vector<Node*>* dropped);
+		
+		Node* adopt(AVLDict& other);
+		
+		Node* cloneNodes(Node* subtree, Node* parent);
+		
+		void finishBulk(Node* new_root, const std::vector<Node*>& dropped);
+		
+		// nodes that a set operation gives a thread of its own, per half
+		static const size_t kForkGrain = 16 * 1024;
+		
 		static Node* subtreeMax(Node* subtree);
 		
 		static Node* subtreeMaxKey(Node* subtree, Node* parent);
@@ -148,11 +290,26 @@ class AVLDict {
 		
 		Node* erase_node(Node* node);
 		
+		typedef typename std::allocator_traits<A>::template rebind_alloc<Node> NodeAllocator;
+		typedef std::allocator_traits<NodeAllocator> NodeTraits;
+
+		Node* create_node(Node* parent, const K& key, const V& val);
+		
+		template<typename ForwardIt>
+		Node* buildSorted(ForwardIt& it, size_t n, Node* parent);
+
+		void destroy_node(Node* node);
+
 		Node* root;
+
+		// entry with the largest key, where sorted input is appended
+		Node* max_node;
+
+		NodeAllocator node_alloc;
 		
 	friend class ConstIterator;
 	
-	friend std::ostream& operator<< (std::ostream& os, const AVLDict<K,V>& spDict){
+	friend std::ostream& operator<< (std::ostream& os, const AVLDict<K, V, A>& spDict){
 		printNode(os, spDict.root, "", true);
 		return os;
 	}
@@ -160,13 +317,26 @@ class AVLDict {
 };
 
 
-template<typename K, typename V> 
-AVLDict<K, V>::AVLDict() {
+template<typename K, typename V, typename A> 
+AVLDict<K, V, A>::AVLDict() {
+		root = nullptr;
+		max_node = nullptr;
+}
+
+template<typename K, typename V, typename A> 
+AVLDict<K, V, A>::AVLDict(const A& alloc): node_alloc(alloc) {
 		root = nullptr;
+		max_node = nullptr;
 }
 
-template<typename K, typename V> 
-AVLDict<K, V>::~AVLDict() {
+template<typename K, typename V, typename A> 
+AVLDict<K, V, A>::~AVLDict() {
+	// nodes that need no destructor are left to an allocator that frees
+	// them in bulk, e.g. a PoolAllocator that no one else uses
+	if (std::is_trivially_destructible<Node>::value and internal::releases_in_bulk(node_alloc)) {
+		return;
+	}
+
 	std::stack<Node*> nodes;
 	nodes.push(root);
 	
@@ -178,32 +348,99 @@ AVLDict<K, V>::~AVLDict() {
 			nodes.push(current->left);
 			nodes.push(current->right);
 
-			delete current;
+			destroy_node(current);
 		}
 		
 	}
 }
 
-template<typename K, typename V> 
-AVLDict<K, V>::AVLDict(const AVLDict& bst) {
+template<typename K, typename V, typename A> 
+AVLDict<K, V, A>::AVLDict(const AVLDict& bst):
+                node_alloc(NodeTraits::select_on_container_copy_construction(bst.node_alloc)) {
+	root = nullptr;
+	max_node = nullptr;
 	for (ConstIterator it = bst.begin(); it != bst.end(); it++) {
 		set( (*it).first, (*it).second);
 	}
 }
 
-template<typename K, typename V> 
-bool AVLDict<K, V>::exists(const K& key) const {
+template<typename K, typename V, typename A> 
+AVLDict<K, V, A>::AVLDict(AVLDict&& bst): node_alloc(bst.node_alloc) {
+	root = bst.root;
+	max_node = bst.max_node;
+	bst.root = nullptr;
+	bst.max_node = nullptr;
+}
+
+template<typename K, typename V, typename A> 
+template<typename ForwardIt>
+AVLDict<K, V, A> AVLDict<K, V, A>::from_sorted(ForwardIt first, ForwardIt last, const A& alloc) {
+	size_t n = 0;
+	for (ForwardIt it = first, prev = first; it != last; prev = it++, n++) {
+		assert(n == 0 or (*prev).first < (*it).first);
+	}
+	
+	AVLDict dict(alloc);
+	dict.root = dict.buildSorted(first, n, nullptr);
+	dict.max_node = dict.root == nullptr ? nullptr : subtreeMax(dict.root);
+	return dict;
+}
+
+template<typename K, typename V, typename A> 
+template<typename Range>
+AVLDict<K, V, A> AVLDict<K, V, A>::from_sorted(const Range& range, const A& alloc) {
+	return from_sorted(range.begin(), range.end(), alloc);
+}
+
+// Builds the n entries from it on in order: the lower half into the left
+// subtree, then the middle one, then the upper half. The halves differ by
+// one entry at most, and so do the heights of the subtrees.
+template<typename K, typename V, typename A> 
+template<typename ForwardIt>
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::buildSorted(ForwardIt& it, size_t n, Node* parent) {
+	if (n == 0) {
+		return nullptr;
+	}
+	
+	Node* left = buildSorted(it, n / 2, nullptr);
+	Node* node = create_node(parent, (*it).first, (*it).second);
+	++it;
+	
+	node->left = left;
+	if (left != nullptr) {
+		left->parent = node;
+	}
+	node->right = buildSorted(it, n - n / 2 - 1, node);
+	node->update_height();
+	return node;
+}
+
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::create_node(Node* parent, const K& key, const V& val) {
+	Node* node = NodeTraits::allocate(node_alloc, 1);
+	NodeTraits::construct(node_alloc, node, parent, key, val);
+	return node;
+}
+
+template<typename K, typename V, typename A> 
+void AVLDict<K, V, A>::destroy_node(Node* node) {
+	NodeTraits::destroy(node_alloc, node);
+	NodeTraits::deallocate(node_alloc, node, 1);
+}
+
+template<typename K, typename V, typename A> 
+bool AVLDict<K, V, A>::exists(const K& key) const {
 	return findNode(root, key) != nullptr;
 }
 
-template<typename K, typename V> 
-V& AVLDict<K, V>::get(const K& key){
+template<typename K, typename V, typename A> 
+V& AVLDict<K, V, A>::get(const K& key){
 	Node* node = findNode(root, key);
 	return node->val;
 }
 
-template<typename K, typename V> 
-void AVLDict<K, V>::rebalance(Node* curr_node) {
+template<typename K, typename V, typename A> 
+void AVLDict<K, V, A>::rebalance(Node* curr_node) {
 	int bf = curr_node->balance_factor();
 	if (abs(bf) >= 3 ) {
 		// something went wrong
@@ -243,27 +480,57 @@ void AVLDict<K, V>::rebalance(Node* curr_node) {
 }
 
 
-template<typename K, typename V> 
-void AVLDict<K, V>::set(const K& key, const V& val) {
-	Node* current_node = findNode(root, key);
-	if (current_node != nullptr) {
-		current_node->val = val;
-	} else {		
-		current_node = set(root, nullptr, key, val);
-		while(current_node != nullptr) {
-			current_node->update_height();
-			if (abs(current_node->balance_factor()) >= 2) {
-				rebalance(current_node);
-			}
-			
-			current_node = current_node->parent;
-		}
+template<typename K, typename V, typename A> 
+void AVLDict<K, V, A>::set(const K& key, const V& val) {
+	insert_or_assign(key, val);
+}
+
+template<typename K, typename V, typename A> 
+std::pair<typename AVLDict<K, V, A>::ConstIterator, bool> AVLDict<K, V, A>::insert_or_assign(const K& key, const V& val) {
+	Node* parent;
+	Node** link;
+	Node* node = findLink(key, parent, link);
+	if (node != nullptr) {
+		node->val = val;
+		return std::make_pair(ConstIterator(node, node->left), false);
+	}
+	
+	node = link_node(parent, link, key, val);
+	return std::make_pair(ConstIterator(node, node->left), true);
+}
+
+template<typename K, typename V, typename A> 
+template<typename... Args>
+std::pair<typename AVLDict<K, V, A>::ConstIterator, bool> AVLDict<K, V, A>::try_emplace(const K& key, Args&&... args) {
+	Node* parent;
+	Node** link;
+	Node* node = findLink(key, parent, link);
+	if (node != nullptr) {
+		return std::make_pair(ConstIterator(node, node->left), false);
+	}
+	
+	node = link_node(parent, link, key, V(std::forward<Args>(args)...));
+	return std::make_pair(ConstIterator(node, node->left), true);
+}
+
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::ConstIterator AVLDict<K, V, A>::insert(ConstIterator hint, const K& key, const V& val) {
+	if ((hint.current == nullptr or hint.current == max_node) and (max_node == nullptr or max_node->key < key)) {
+		// the largest node has no right child
+		Node* node = link_node(max_node, max_node == nullptr ? &root : &max_node->right, key, val);
+		return ConstIterator(node, node->left);
 	}
+	
+	return try_emplace(key, val).first;
 }
 
-template<typename K, typename V> 
-void AVLDict<K, V>::erase(const K& key){
+template<typename K, typename V, typename A> 
+void AVLDict<K, V, A>::erase(const K& key){
 	Node* node = findNode(root, key);
+	if (node != nullptr and node == max_node) {
+		// the largest node has no right child and at most a leaf on its left
+		max_node = node->left != nullptr ? node->left : node->parent;
+	}
 	node = erase_node(node);
 	
 	while(node != nullptr) {
@@ -276,78 +543,631 @@ void AVLDict<K, V>::erase(const K& key){
 	}
 }
 
-template<typename K, typename V> 
-typename AVLDict<K,V>::ConstIterator AVLDict<K, V>::begin(){
+template<typename K, typename V, typename A> 
+size_t AVLDict<K, V, A>::size() const {
+	return subtreeSize(root);
+}
+
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::ConstIterator AVLDict<K, V, A>::select(size_t k) {
+	Node* node = root;
+	while (node != nullptr) {
+		size_t left_size = subtreeSize(node->left);
+		if (k < left_size) {
+			node = node->left;
+		} else if (k == left_size) {
+			return ConstIterator(node, node->left);
+		} else {
+			k -= left_size + 1;
+			node = node->right;
+		}
+	}
+	return end();
+}
+
+template<typename K, typename V, typename A> 
+size_t AVLDict<K, V, A>::rank(const K& key) const {
+	size_t below = 0;
+	Node* node = root;
+	while (node != nullptr) {
+		if (node->key < key) {
+			below += subtreeSize(node->left) + 1;
+			node = node->right;
+		} else {
+			node = node->left;
+		}
+	}
+	return below;
+}
+
+template<typename K, typename V, typename A> 
+size_t AVLDict<K, V, A>::count_range(const K& lo, const K& hi) const {
+	if (!(lo < hi)) {
+		return 0;
+	}
+	return rank(hi) - rank(lo);
+}
+
+template<typename K, typename V, typename A> 
+void AVLDict<K, V, A>::union_with(AVLDict& other, unsigned threads) {
+	if (this == &other) {
+		return;
+	}
+	
+	std::vector<Node*> dropped;
+	Node* nodes = adopt(other);
+	Node* own = detach(root);
+	root = nullptr;
+	finishBulk(unionNodes(own, nodes, &dropped, threads), dropped);
+}
+
+template<typename K, typename V, typename A> 
+void AVLDict<K, V, A>::intersect_with(AVLDict& other, unsigned threads) {
+	if (this == &other) {
+		return;
+	}
+	
+	std::vector<Node*> dropped;
+	Node* nodes = adopt(other);
+	Node* own = detach(root);
+	root = nullptr;
+	finishBulk(intersectNodes(own, nodes, &dropped, threads), dropped);
+}
+
+template<typename K, typename V, typename A> 
+void AVLDict<K, V, A>::difference(AVLDict& other, unsigned threads) {
+	std::vector<Node*> dropped;
+	if (this == &other) {
+		dropSubtree(root, &dropped);
+		finishBulk(nullptr, dropped);
+		return;
+	}
+	
+	Node* nodes = adopt(other);
+	Node* own = detach(root);
+	root = nullptr;
+	finishBulk(differenceNodes(own, nodes, &dropped, threads), dropped);
+}
+
+template<typename K, typename V, typename A> 
+AVLDict<K, V, A> AVLDict<K, V, A>::split(const K& key) {
+	AVLDict right_dict{A(node_alloc)};
+	
+	Node* own = detach(root);
+	root = nullptr;
+	
+	Node* left;
+	Node* right;
+	Node* middle = splitNodes(own, key, left, right);
+	if (middle != nullptr) {
+		right = joinNodes(nullptr, middle, right);
+	}
+	
+	std::vector<Node*> dropped;
+	finishBulk(left, dropped);
+	right_dict.finishBulk(right, dropped);
+	return right_dict;
+}
+
+template<typename K, typename V, typename A> 
+void AVLDict<K, V, A>::join(AVLDict& right) {
+	if (this == &right) {
+		return;
+	}
+	assert(max_node == nullptr or right.root == nullptr or max_node->key < subtreeMin(right.root)->key);
+	
+	std::vector<Node*> dropped;
+	Node* nodes = adopt(right);
+	Node* own = detach(root);
+	root = nullptr;
+	finishBulk(concatNodes(own, nodes), dropped);
+}
+
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::ConstIterator AVLDict<K, V, A>::begin(){
 	ConstIterator it = ConstIterator(root);
 	return it;
 }
 
-template<typename K, typename V> 
-typename AVLDict<K,V>::ConstIterator AVLDict<K, V>::end(){
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::ConstIterator AVLDict<K, V, A>::end(){
 	ConstIterator it = ConstIterator(nullptr, root);
 	return it;
 }
 
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::ConstIterator AVLDict<K, V, A>::lower_bound(const K& key){
+	Node* node = lowerNode(key);
+	return ConstIterator(node, node == nullptr ? root : node->left);
+}
 
-template<typename K, typename V> 
-typename AVLDict<K, V>::Node* AVLDict<K, V>::findNode(Node* subtree, const K& key) const{
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::ConstIterator AVLDict<K, V, A>::upper_bound(const K& key){
+	Node* node = upperNode(key);
+	return ConstIterator(node, node == nullptr ? root : node->left);
+}
+
+template<typename K, typename V, typename A> 
+std::pair<typename AVLDict<K, V, A>::ConstIterator, typename AVLDict<K, V, A>::ConstIterator> AVLDict<K, V, A>::equal_range(const K& key){
+	ConstIterator first = lower_bound(key);
+	return std::make_pair(first, upper_bound(key));
+}
+
+template<typename K, typename V, typename A> 
+template<typename F>
+void AVLDict<K, V, A>::for_each_in_range(const K& lo, const K& hi, F fn){
+	// the nodes still to visit, at most one per level; an AVL tree of 2^64
+	// nodes is less than 93 levels high
+	Node* pending[96];
+	int top = 0;
+	
+	for (Node* node = root; node != nullptr; ) {
+		if (node->key < lo) {
+			node = node->right;
+		} else {
+			pending[top++] = node;
+			node = node->left;
+		}
+	}
+	
+	while (top > 0) {
+		Node* node = pending[--top];
+		if (!(node->key < hi) or !fn(node->key, node->val)) {
+			return;
+		}
+		for (Node* child = node->right; child != nullptr; child = child->left) {
+			pending[top++] = child;
+		}
+	}
+}
+
+
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::findNode(Node* subtree, const K& key) const{
+	while (subtree != nullptr and !(subtree->key == key)) {
+		subtree = key < subtree->key ? subtree->left : subtree->right;
+	}
+	return subtree;
+}
+
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::lowerNode(const K& key) const{
+	Node* bound = nullptr;
+	Node* node = root;
+	while (node != nullptr) {
+		if (node->key < key) {
+			node = node->right;
+		} else {
+			bound = node;
+			node = node->left;
+		}
+	}
+	return bound;
+}
+
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::upperNode(const K& key) const{
+	Node* bound = nullptr;
+	Node* node = root;
+	while (node != nullptr) {
+		if (key < node->key) {
+			bound = node;
+			node = node->left;
+		} else {
+			node = node->right;
+		}
+	}
+	return bound;
+}
+
+// Walks down from the root once. Returns the node of key, or nullptr with
+// the pointer a new node for key would hang from in link.
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::findLink(const K& key, Node*& parent, Node**& link){
+	parent = nullptr;
+	link = &root;
+	while (*link != nullptr) {
+		Node* node = *link;
+		if (node->key == key) {
+			return node;
+		}
+		parent = node;
+		link = key < node->key ? &node->left : &node->right;
+	}
+	return nullptr;
+}
+
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::link_node(Node* parent, Node** link, const K& key, const V& val){
+	Node* node = create_node(parent, key, val);
+	*link = node;
+	if (max_node == nullptr or (parent == max_node and link == &parent->right)) {
+		max_node = node;
+	}
+	
+	insert_fixup(node);
+	return node;
+}
+
+// Updates the heights above a new leaf. They stop changing at the first
+// node whose height stays the same, or after a rotation, which gives the
+// subtree back its old height, so sorted inserts rebalance O(1) nodes
+// amortized. The nodes further up still count one more node below them,
+// which takes O(log n) on every insert.
+template<typename K, typename V, typename A> 
+void AVLDict<K, V, A>::insert_fixup(Node* node){
+	Node* current = node->parent;
+	while (current != nullptr) {
+		int old_height = current->height;
+		current->update_height();
+		if (abs(current->balance_factor()) >= 2) {
+			rebalance(current);
+			// current went down, the new root of its subtree is up to date
+			current = current->parent->parent;
+			break;
+		}
+		
+		bool grew = current->height != old_height;
+		current = current->parent;
+		if (!grew) {
+			break;
+		}
+	}
+	
+	for (; current != nullptr; current = current->parent) {
+		current->size++;
+	}
+}
+
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::subtreeMaxKey(Node* subtree, Node* parent){
 	if (subtree == nullptr){
+		return parent;
+	}
+	else {
+		return subtreeMaxKey(subtree->right, subtree);
+	}
+}
+
+
+template<typename K, typename V, typename A> 
+size_t AVLDict<K, V, A>::subtreeSize(Node* subtree){
+	return subtree == nullptr ? 0 : subtree->size;
+}
+
+template<typename K, typename V, typename A> 
+int AVLDict<K, V, A>::heightOf(Node* subtree){
+	return subtree == nullptr ? 0 : subtree->height;
+}
+
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::detach(Node* subtree){
+	if (subtree != nullptr) {
+		subtree->parent = nullptr;
+	}
+	return subtree;
+}
+
+// The set operations work on detached subtrees, whose roots have no
+// parent. root is cleared while they run, so rebalance() never takes a
+// subtree root for it.
+
+// Joins left, the single node middle and right, whose keys come in that
+// order, into one balanced subtree.
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::joinNodes(Node* left, Node* middle, Node* right){
+	if (heightOf(left) > heightOf(right) + 1) {
+		return joinRight(left, middle, right);
+	}
+	if (heightOf(right) > heightOf(left) + 1) {
+		return joinLeft(left, middle, right);
+	}
+	
+	middle->left = left;
+	middle->right = right;
+	middle->parent = nullptr;
+	if (left != nullptr) {
+		left->parent = middle;
+	}
+	if (right != nullptr) {
+		right->parent = middle;
+	}
+	middle->update_height();
+	return middle;
+}
+
+// left is the higher one: middle and right go down its right spine, to the
+// first node about as high as right, and the spine is rebalanced on the way
+// back up, in O(height(left) - height(right)).
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::joinRight(Node* left, Node* middle, Node* right){
+	Node* parent = nullptr;
+	Node* current = left;
+	while (heightOf(current) > heightOf(right) + 1) {
+		parent = current;
+		current = current->right;
+	}
+	
+	middle->left = current;
+	middle->right = right;
+	if (current != nullptr) {
+		current->parent = middle;
+	}
+	if (right != nullptr) {
+		right->parent = middle;
+	}
+	middle->update_height();
+	
+	parent->right = middle;
+	middle->parent = parent;
+	
+	Node* node = parent;
+	while (true) {
+		node->update_height();
+		if (abs(node->balance_factor()) >= 2) {
+			rebalance(node);
+			node = node->parent;
+		}
+		if (node->parent == nullptr) {
+			return node;
+		}
+		node = node->parent;
+	}
+}
+
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::joinLeft(Node* left, Node* middle, Node* right){
+	Node* parent = nullptr;
+	Node* current = right;
+	while (heightOf(current) > heightOf(left) + 1) {
+		parent = current;
+		current = current->left;
+	}
+	
+	middle->left = left;
+	middle->right = current;
+	if (left != nullptr) {
+		left->parent = middle;
+	}
+	if (current != nullptr) {
+		current->parent = middle;
+	}
+	middle->update_height();
+	
+	parent->left = middle;
+	middle->parent = parent;
+	
+	Node* node = parent;
+	while (true) {
+		node->update_height();
+		if (abs(node->balance_factor()) >= 2) {
+			rebalance(node);
+			node = node->parent;
+		}
+		if (node->parent == nullptr) {
+			return node;
+		}
+		node = node->parent;
+	}
+}
+
+// joinNodes() without a middle node, the largest one of left takes its place
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::concatNodes(Node* left, Node* right){
+	if (left == nullptr) {
+		return right;
+	}
+	if (right == nullptr) {
+		return left;
+	}
+	
+	Node* rest;
+	Node* none;
+	Node* largest = splitNodes(left, subtreeMax(left)->key, rest, none);
+	return joinNodes(rest, largest, right);
+}
+
+// Splits subtree into the keys below key, in left, and above key, in right.
+// Returns the detached node of key, or nullptr.
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::splitNodes(Node* subtree, const K& key, Node*& left, Node*& right){
+	if (subtree == nullptr) {
+		left = nullptr;
+		right = nullptr;
 		return nullptr;
 	}
-	else if (subtree->key == key) {
+	
+	Node* subtree_left = detach(subtree->left);
+	Node* subtree_right = detach(subtree->right);
+	subtree->left = nullptr;
+	subtree->right = nullptr;
+	
+	if (subtree->key == key) {
+		left = subtree_left;
+		right = subtree_right;
+		subtree->update_height();
 		return subtree;
 	}
 	else if (key < subtree->key) {
-		return findNode(subtree->left, key);
+		Node* middle;
+		Node* found = splitNodes(subtree_left, key, left, middle);
+		right = joinNodes(middle, subtree, subtree_right);
+		return found;
 	}
 	else {
-		return findNode(subtree->right, key);
-	}  
+		Node* middle;
+		Node* found = splitNodes(subtree_right, key, middle, right);
+		left = joinNodes(subtree_left, subtree, middle);
+		return found;
+	}
 }
 
+// t1 is split around the root of t2, which stays with its value, and the
+// halves are merged with the subtrees of that root.
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::unionNodes(Node* t1, Node* t2, std::vector<Node*>* dropped, unsigned threads){
+	if (t1 == nullptr) {
+		return t2;
+	}
+	if (t2 == nullptr) {
+		return t1;
+	}
+	
+	Node* l2 = detach(t2->left);
+	Node* r2 = detach(t2->right);
+	Node* l1;
+	Node* r1;
+	Node* same = splitNodes(t1, t2->key, l1, r1);
+	if (same != nullptr) {
+		dropped->push_back(same);
+	}
+	
+	Node* left;
+	Node* right;
+	forkJoin(&AVLDict::unionNodes, l1, l2, left, r1, r2, right, dropped, threads);
+	return joinNodes(left, t2, right);
+}
 
-template<typename K, typename V> 
-typename AVLDict<K, V>::Node* AVLDict<K, V>::set(Node*& subtree, Node* parent, const K& key, const V& val){
-	if (subtree == nullptr) {
-		// by using the reference to pointer, we update parent's pointer 
-		subtree = new Node(parent, key, val);
-		return subtree;
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::intersectNodes(Node* t1, Node* t2, std::vector<Node*>* dropped, unsigned threads){
+	if (t1 == nullptr or t2 == nullptr) {
+		dropSubtree(t1, dropped);
+		dropSubtree(t2, dropped);
+		return nullptr;
 	}
-	else if (subtree->key == key) {
-		assert(false);
-		// Should not happen
+	
+	Node* l2 = detach(t2->left);
+	Node* r2 = detach(t2->right);
+	Node* l1;
+	Node* r1;
+	Node* same = splitNodes(t1, t2->key, l1, r1);
+	dropped->push_back(t2);
+	
+	Node* left;
+	Node* right;
+	forkJoin(&AVLDict::intersectNodes, l1, l2, left, r1, r2, right, dropped, threads);
+	if (same != nullptr) {
+		return joinNodes(left, same, right);
 	}
-	else if (key < subtree->key) {
-		return set(subtree->left, subtree, key, val);
+	return concatNodes(left, right);
+}
+
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::differenceNodes(Node* t1, Node* t2, std::vector<Node*>* dropped, unsigned threads){
+	if (t1 == nullptr or t2 == nullptr) {
+		dropSubtree(t2, dropped);
+		return t1;
 	}
-	else {
-		return set(subtree->right, subtree, key, val);
+	
+	Node* l2 = detach(t2->left);
+	Node* r2 = detach(t2->right);
+	Node* l1;
+	Node* r1;
+	Node* same = splitNodes(t1, t2->key, l1, r1);
+	if (same != nullptr) {
+		dropped->push_back(same);
 	}
+	dropped->push_back(t2);
+	
+	Node* left;
+	Node* right;
+	forkJoin(&AVLDict::differenceNodes, l1, l2, left, r1, r2, right, dropped, threads);
+	return concatNodes(left, right);
 }
 
-template<typename K, typename V> 
-typename AVLDict<K,V>::Node* AVLDict<K, V>::subtreeMaxKey(Node* subtree, Node* parent){
-	if (subtree == nullptr){
-		return parent;
+// Runs op on (l1, l2) and (r1, r2). The left pair goes to a thread of its
+// own when there are threads to spare and both pairs are large enough to
+// pay for one. Each thread collects its dropped nodes apart.
+template<typename K, typename V, typename A> 
+void AVLDict<K, V, A>::forkJoin(SetOp op, Node* l1, Node* l2, Node*& left, Node* r1, Node* r2, Node*& right,
+                                std::vector<Node*>* dropped, unsigned threads){
+	if (threads > 1 and subtreeSize(l1) + subtreeSize(l2) >= kForkGrain
+	    and subtreeSize(r1) + subtreeSize(r2) >= kForkGrain) {
+		std::vector<Node*> left_dropped;
+		std::thread worker([&]() {
+			left = (this->*op)(l1, l2, &left_dropped, threads / 2);
+		});
+		right = (this->*op)(r1, r2, dropped, threads - threads / 2);
+		worker.join();
+		dropped->insert(dropped->end(), left_dropped.begin(), left_dropped.end());
 	}
 	else {
-		return subtreeMaxKey(subtree->right, subtree);
+		left = (this->*op)(l1, l2, dropped, threads);
+		right = (this->*op)(r1, r2, dropped, threads);
+	}
+}
+
+template<typename K, typename V, typename A> 
+void AVLDict<K, V, A>::dropSubtree(Node* subtree, std::vector<Node*>* dropped){
+	std::stack<Node*> nodes;
+	nodes.push(subtree);
+	
+	while(!nodes.empty()){
+		Node* current = nodes.top();
+		nodes.pop();
+		
+		if (current != nullptr){
+			nodes.push(current->left);
+			nodes.push(current->right);
+			dropped->push_back(current);
+		}
+	}
+}
+
+// Takes the nodes of other. Nodes from an allocator that is not equal to
+// this one are copied, so that they can be freed here.
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::adopt(AVLDict& other){
+	Node* nodes = detach(other.root);
+	other.root = nullptr;
+	other.max_node = nullptr;
+	if (node_alloc == other.node_alloc) {
+		return nodes;
+	}
+	
+	Node* copy = cloneNodes(nodes, nullptr);
+	std::vector<Node*> dropped;
+	dropSubtree(nodes, &dropped);
+	for (Node* node : dropped) {
+		other.destroy_node(node);
+	}
+	return copy;
+}
+
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::cloneNodes(Node* subtree, Node* parent){
+	if (subtree == nullptr) {
+		return nullptr;
 	}
+	
+	Node* node = create_node(parent, subtree->key, subtree->val);
+	node->left = cloneNodes(subtree->left, node);
+	node->right = cloneNodes(subtree->right, node);
+	node->update_height();
+	return node;
 }
 
+template<typename K, typename V, typename A> 
+void AVLDict<K, V, A>::finishBulk(Node* new_root, const std::vector<Node*>& dropped){
+	root = new_root;
+	max_node = root == nullptr ? nullptr : subtreeMax(root);
+	for (Node* node : dropped) {
+		destroy_node(node);
+	}
+}
 
-template<typename K, typename V> 
-typename AVLDict<K,V>::Node* AVLDict<K, V>::subtreeMin(Node* subtree){
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::subtreeMin(Node* subtree){
 	return subtreeMinKey(subtree->left, subtree);
 }
 
-template<typename K, typename V> 
-typename AVLDict<K,V>::Node* AVLDict<K, V>::subtreeMax(Node* subtree){
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::subtreeMax(Node* subtree){
 	return subtreeMaxKey(subtree->right, subtree);
 }
 
-template<typename K, typename V> 
-typename AVLDict<K,V>::Node* AVLDict<K, V>::subtreeMinKey(Node* subtree, Node* parent){
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::subtreeMinKey(Node* subtree, Node* parent){
 	if (subtree == nullptr){
 		return parent;
 	}
@@ -356,8 +1176,8 @@ typename AVLDict<K,V>::Node* AVLDict<K, V>::subtreeMinKey(Node* subtree, Node* p
 	}
 }
 
-template<typename K, typename V> 
-typename AVLDict<K,V>::Node* AVLDict<K,V>::erase_node(Node* node){
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::Node* AVLDict<K, V, A>::erase_node(Node* node){
 
   if (node->left == nullptr and node->right == nullptr){
     if (node != root){
@@ -372,7 +1192,7 @@ typename AVLDict<K,V>::Node* AVLDict<K,V>::erase_node(Node* node){
     Node* res = node->parent;
     res->update_height();
     
-    delete node;
+    destroy_node(node);
     
     return res;
   }
@@ -416,41 +1236,42 @@ typename AVLDict<K,V>::Node* AVLDict<K,V>::erase_node(Node* node){
 		child->parent->update_height();
 	}
     
-    delete node;
+    destroy_node(node);
     return child;
     
   }
   
 }
 
-template<typename K, typename V> 
-const std::pair<K&, V&> AVLDict<K, V>::ConstIterator::operator*() const {
+template<typename K, typename V, typename A> 
+const std::pair<K&, V&> AVLDict<K, V, A>::ConstIterator::operator*() const {
 	std::pair<K&, V&> res {current->key, current->val};
 	return res;
 }
 
 
-template<typename K, typename V> 
-typename AVLDict<K,V>::ConstIterator& AVLDict<K, V>::ConstIterator::operator=(const ConstIterator& it) {
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::ConstIterator& AVLDict<K, V, A>::ConstIterator::operator=(const ConstIterator& it) {
 	current = it.current;
 	prev = it.prev;
 	
 	return *this;
 }
 
-template<typename K, typename V> 
-bool AVLDict<K, V>::ConstIterator::operator==(const ConstIterator& it) const {
-	return (current == it.current and prev == it.prev);
+template<typename K, typename V, typename A> 
+bool AVLDict<K, V, A>::ConstIterator::operator==(const ConstIterator& it) const {
+	// prev depends on the way current was reached
+	return current == it.current;
 }
 
-template<typename K, typename V> 
-bool AVLDict<K, V>::ConstIterator::operator!=(const ConstIterator& it) const {
+template<typename K, typename V, typename A> 
+bool AVLDict<K, V, A>::ConstIterator::operator!=(const ConstIterator& it) const {
 	return !(*this == it);
 }
 
 
-template<typename K, typename V> 
-typename AVLDict<K,V>::ConstIterator& AVLDict<K, V>::ConstIterator::operator++(int) {
+template<typename K, typename V, typename A> 
+typename AVLDict<K, V, A>::ConstIterator& AVLDict<K, V, A>::ConstIterator::operator++(int) {
 	if (prev != nullptr and prev->left == current) {
 		if (current->right != nullptr){
 			current = subtreeMin(current->right);
@@ -489,8 +1310,8 @@ typename AVLDict<K,V>::ConstIterator& AVLDict<K, V>::ConstIterator::operator++(i
 	return *this;
 }
 
-template<typename K, typename V>
-void AVLDict<K, V>::rightRotate(Node* n) {
+template<typename K, typename V, typename A>
+void AVLDict<K, V, A>::rightRotate(Node* n) {
 	Node* new_root = n->left;
 	
 	n->left = new_root->right;
@@ -511,12 +1332,13 @@ void AVLDict<K, V>::rightRotate(Node* n) {
 		new_root->parent->right = new_root;
 	}
 	
-	new_root->update_height();
+	// n is now below new_root
 	n->update_height();
+	new_root->update_height();
 }
 
-template<typename K, typename V>
-void AVLDict<K, V>::leftRotate(Node* n) {
+template<typename K, typename V, typename A>
+void AVLDict<K, V, A>::leftRotate(Node* n) {
 	assert(n != nullptr);
 	assert(n->right != nullptr);
 	
@@ -540,13 +1362,14 @@ void AVLDict<K, V>::leftRotate(Node* n) {
 		new_root->parent->right = new_root;
 	}
 	
-	new_root->update_height();
+	// n is now below new_root
 	n->update_height();
+	new_root->update_height();
 }
 
 
-template<typename K, typename V>
-void AVLDict<K,V>::printNode(std::ostream& os, Node* node, std::string prefix, bool isTail){
+template<typename K, typename V, typename A>
+void AVLDict<K, V, A>::printNode(std::ostream& os, Node* node, std::string prefix, bool isTail){
 		if (node == nullptr){
 			return;
 		}
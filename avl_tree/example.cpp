@@ -1,5 +1,6 @@
 #include <iostream>
 #include "avl_tree.hpp"
+#include "persistent_avl_tree.hpp"
 #include <string>
 
 int main(){
@@ -32,6 +33,48 @@ int main(){
   std::cout<<avl_dict.get(-2)<<std::endl;
   
   std::cout << avl_dict << std::endl;
+
+  // nodes carved out of contiguous chunks, all freed at once with the tree
+  dicts::AVLDict<int, int, dicts::PoolAllocator<int> > pooled;
+  // sorted keys are appended after the last one without a search
+  for (int i = 0; i < 100000; i++) {
+    pooled.insert(pooled.end(), i, i);
+  }
+  std::cout << pooled.get(4242) << std::endl;
+
+  // order statistics in O(log n)
+  std::cout << (*pooled.select(pooled.size() * 99 / 100)).first << " "
+            << pooled.rank(500) << " " << pooled.count_range(100, 200) << std::endl;
+
+  // keys in [1000, 2000) until the sum passes 5000
+  int sum = 0;
+  pooled.for_each_in_range(1000, 2000, [&sum](const int& key, int& val) {
+    sum += val;
+    return sum <= 5000;
+  });
+  std::cout << sum << " " << (*pooled.lower_bound(1500)).first << std::endl;
+
+  // split and join move whole subtrees, in O(log n)
+  dicts::AVLDict<int, int, dicts::PoolAllocator<int> > tail(pooled.split(99000));
+  std::cout << pooled.size() << " " << tail.size() << " ";
+  pooled.join(tail);
+
+  // set operations take the entries of their argument
+  dicts::AVLDict<int, int, dicts::PoolAllocator<int> > evens;
+  for (int i = 0; i < 200000; i += 2) {
+    evens.insert(evens.end(), i, -i);
+  }
+  pooled.union_with(evens, std::thread::hardware_concurrency());
+  std::cout << pooled.size() << " " << pooled.get(4242) << std::endl;
+
+  // a snapshot shares the nodes and keeps its version while the dict moves on
+  dicts::PersistentAVLDict<int, std::string> versions;
+  versions.set(1, "one");
+  dicts::PersistentAVLDict<int, std::string> before = versions.snapshot();
+  versions.set(1, "uno");
+  versions.set(2, "dos");
+  std::cout << before.get(1) << " " << before.size() << " "
+            << versions.get(1) << " " << versions.size() << std::endl;
   
   
 }
@@ -0,0 +1,443 @@
+#ifndef PERSISTENT_AVL_TREE_H_
+#define PERSISTENT_AVL_TREE_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace dicts {
+
+// AVL tree whose versions share their nodes. Copies and snapshot() take a
+// reference to the root in O(1). set() and erase() copy the O(log n) nodes
+// on the path to the key that another version still points to, and update
+// the others in place, so no version ever sees the updates of another one.
+//
+// Shared nodes are never written and their reference counts are atomic:
+// versions can be read and updated on different threads without locks, as
+// long as each dict object is used by one thread at a time. The thread that
+// drops the last reference to a node frees it, so the allocator has to be
+// thread safe when versions are released on several threads; std::allocator
+// is, PoolAllocator is not.
+template<typename K, typename V, typename A = std::allocator<std::pair<const K, V> > >
+class PersistentAVLDict {
+	private:
+		struct Node; //Forward declaration
+
+	public:
+		// stays valid while the version it comes from is not updated, e.g.
+		// on a snapshot
+		class ConstIterator {
+			public:
+				const std::pair<const K&, const V&> operator*() const;
+
+				ConstIterator& operator++ (int);
+
+				bool operator== (const ConstIterator& const_it) const;
+
+				bool operator!= (const ConstIterator& const_it) const;
+
+			private:
+				void pushLeft(Node* subtree);
+
+				// the current node on top of its ancestors whose left
+				// subtree is being visited
+				std::vector<Node*> pending;
+
+			friend class PersistentAVLDict;
+		};
+
+
+		PersistentAVLDict();
+
+		// nodes are allocated with alloc
+		explicit PersistentAVLDict(const A& alloc);
+
+		// shares the nodes of bst, in O(1)
+		PersistentAVLDict(const PersistentAVLDict& bst);
+
+		PersistentAVLDict(PersistentAVLDict&& bst);
+
+		~PersistentAVLDict();
+
+		PersistentAVLDict& operator= (const PersistentAVLDict& bst);
+
+		// the current version, which later set() and erase() calls on this
+		// dict leave as it is, in O(1)
+		PersistentAVLDict snapshot() const;
+
+		bool exists(const K& key) const;
+
+		const V& get(const K& key) const;
+
+		void set(const K& key, const V& val);
+
+		void erase(const K& key);
+
+		size_t size() const;
+
+		ConstIterator begin() const;
+
+		ConstIterator end() const;
+
+	private:
+		struct Node {
+			K key;
+			V val;
+
+			Node* left;
+			Node* right;
+
+			int height;
+
+			// versions and nodes that point to this node
+			std::atomic<size_t> refs;
+
+			Node(const K& k, const V& v): key(k), val(v), left(nullptr), right(nullptr), height(1), refs(1) {}
+		};
+
+		Node* findNode(const K& key) const;
+
+		static int heightOf(Node* subtree);
+
+		static void updateHeight(Node* node);
+
+		static Node* retain(Node* node);
+
+		void release(Node* node);
+
+		Node* own(Node* node);
+
+		Node* rotateLeft(Node* node);
+
+		Node* rotateRight(Node* node);
+
+		Node* rebalance(Node* node);
+
+		Node* insertNode(Node* subtree, const K& key, const V& val);
+
+		Node* eraseNode(Node* subtree, const K& key);
+
+		typedef typename std::allocator_traits<A>::template rebind_alloc<Node> NodeAllocator;
+		typedef std::allocator_traits<NodeAllocator> NodeTraits;
+
+		Node* create_node(const K& key, const V& val);
+
+		void destroy_node(Node* node);
+
+		Node* root;
+
+		size_t count;
+
+		NodeAllocator node_alloc;
+};
+
+
+template<typename K, typename V, typename A> 
+PersistentAVLDict<K, V, A>::PersistentAVLDict() {
+	root = nullptr;
+	count = 0;
+}
+
+template<typename K, typename V, typename A> 
+PersistentAVLDict<K, V, A>::PersistentAVLDict(const A& alloc): node_alloc(alloc) {
+	root = nullptr;
+	count = 0;
+}
+
+// the allocator is shared rather than selected for the copy, it frees the
+// nodes of both
+template<typename K, typename V, typename A> 
+PersistentAVLDict<K, V, A>::PersistentAVLDict(const PersistentAVLDict& bst): node_alloc(bst.node_alloc) {
+	root = retain(bst.root);
+	count = bst.count;
+}
+
+template<typename K, typename V, typename A> 
+PersistentAVLDict<K, V, A>::PersistentAVLDict(PersistentAVLDict&& bst): node_alloc(bst.node_alloc) {
+	root = bst.root;
+	count = bst.count;
+	bst.root = nullptr;
+	bst.count = 0;
+}
+
+template<typename K, typename V, typename A> 
+PersistentAVLDict<K, V, A>::~PersistentAVLDict() {
+	release(root);
+}
+
+template<typename K, typename V, typename A> 
+PersistentAVLDict<K, V, A>& PersistentAVLDict<K, V, A>::operator= (const PersistentAVLDict& bst) {
+	Node* old_root = root;
+	root = retain(bst.root);
+	count = bst.count;
+	release(old_root);
+	return *this;
+}
+
+template<typename K, typename V, typename A> 
+PersistentAVLDict<K, V, A> PersistentAVLDict<K, V, A>::snapshot() const {
+	return *this;
+}
+
+template<typename K, typename V, typename A> 
+typename PersistentAVLDict<K, V, A>::Node* PersistentAVLDict<K, V, A>::create_node(const K& key, const V& val) {
+	Node* node = NodeTraits::allocate(node_alloc, 1);
+	NodeTraits::construct(node_alloc, node, key, val);
+	return node;
+}
+
+template<typename K, typename V, typename A> 
+void PersistentAVLDict<K, V, A>::destroy_node(Node* node) {
+	NodeTraits::destroy(node_alloc, node);
+	NodeTraits::deallocate(node_alloc, node, 1);
+}
+
+template<typename K, typename V, typename A> 
+bool PersistentAVLDict<K, V, A>::exists(const K& key) const {
+	return findNode(key) != nullptr;
+}
+
+template<typename K, typename V, typename A> 
+const V& PersistentAVLDict<K, V, A>::get(const K& key) const {
+	Node* node = findNode(key);
+	assert(node != nullptr);
+	return node->val;
+}
+
+template<typename K, typename V, typename A> 
+void PersistentAVLDict<K, V, A>::set(const K& key, const V& val) {
+	root = insertNode(root, key, val);
+}
+
+template<typename K, typename V, typename A> 
+void PersistentAVLDict<K, V, A>::erase(const K& key) {
+	// an absent key would copy the path for nothing
+	if (findNode(key) == nullptr) {
+		return;
+	}
+	root = eraseNode(root, key);
+	count--;
+}
+
+template<typename K, typename V, typename A> 
+size_t PersistentAVLDict<K, V, A>::size() const {
+	return count;
+}
+
+template<typename K, typename V, typename A> 
+typename PersistentAVLDict<K, V, A>::ConstIterator PersistentAVLDict<K, V, A>::begin() const {
+	ConstIterator it;
+	it.pushLeft(root);
+	return it;
+}
+
+template<typename K, typename V, typename A> 
+typename PersistentAVLDict<K, V, A>::ConstIterator PersistentAVLDict<K, V, A>::end() const {
+	return ConstIterator();
+}
+
+template<typename K, typename V, typename A> 
+typename PersistentAVLDict<K, V, A>::Node* PersistentAVLDict<K, V, A>::findNode(const K& key) const {
+	Node* current = root;
+	while (current != nullptr) {
+		if (key < current->key) {
+			current = current->left;
+		} else if (current->key < key) {
+			current = current->right;
+		} else {
+			return current;
+		}
+	}
+	return nullptr;
+}
+
+template<typename K, typename V, typename A> 
+int PersistentAVLDict<K, V, A>::heightOf(Node* subtree) {
+	return subtree == nullptr ? 0 : subtree->height;
+}
+
+template<typename K, typename V, typename A> 
+void PersistentAVLDict<K, V, A>::updateHeight(Node* node) {
+	int lh = heightOf(node->left);
+	int rh = heightOf(node->right);
+	node->height = (lh > rh ? lh : rh) + 1;
+}
+
+template<typename K, typename V, typename A> 
+typename PersistentAVLDict<K, V, A>::Node* PersistentAVLDict<K, V, A>::retain(Node* node) {
+	if (node != nullptr) {
+		node->refs.fetch_add(1, std::memory_order_relaxed);
+	}
+	return node;
+}
+
+// The last reference frees the node, after the reads of the threads that
+// dropped the others (acq_rel).
+template<typename K, typename V, typename A> 
+void PersistentAVLDict<K, V, A>::release(Node* node) {
+	if (node != nullptr and node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		release(node->left);
+		release(node->right);
+		destroy_node(node);
+	}
+}
+
+// Takes the reference to node that the caller holds and returns a node with
+// the same entry and children that only the caller points to: node itself
+// when nothing else does, otherwise a copy. The callers own the path from
+// the root down, so a node is only updated in place when no other version
+// can reach it.
+template<typename K, typename V, typename A> 
+typename PersistentAVLDict<K, V, A>::Node* PersistentAVLDict<K, V, A>::own(Node* node) {
+	if (node->refs.load(std::memory_order_acquire) == 1) {
+		return node;
+	}
+
+	Node* copy = create_node(node->key, node->val);
+	copy->left = retain(node->left);
+	copy->right = retain(node->right);
+	copy->height = node->height;
+	release(node);
+	return copy;
+}
+
+// node is owned, the returned subtree root as well
+template<typename K, typename V, typename A> 
+typename PersistentAVLDict<K, V, A>::Node* PersistentAVLDict<K, V, A>::rotateLeft(Node* node) {
+	Node* new_root = own(node->right);
+	node->right = new_root->left;
+	new_root->left = node;
+
+	// node is now below new_root
+	updateHeight(node);
+	updateHeight(new_root);
+	return new_root;
+}
+
+template<typename K, typename V, typename A> 
+typename PersistentAVLDict<K, V, A>::Node* PersistentAVLDict<K, V, A>::rotateRight(Node* node) {
+	Node* new_root = own(node->left);
+	node->left = new_root->right;
+	new_root->right = node;
+
+	// node is now below new_root
+	updateHeight(node);
+	updateHeight(new_root);
+	return new_root;
+}
+
+template<typename K, typename V, typename A> 
+typename PersistentAVLDict<K, V, A>::Node* PersistentAVLDict<K, V, A>::rebalance(Node* node) {
+	updateHeight(node);
+	int bf = heightOf(node->right) - heightOf(node->left);
+
+	if (bf == 2) {
+		if (heightOf(node->right->right) < heightOf(node->right->left)) {
+			node->right = rotateRight(own(node->right));
+		}
+		return rotateLeft(node);
+	} else if (bf == -2) {
+		if (heightOf(node->left->left) < heightOf(node->left->right)) {
+			node->left = rotateLeft(own(node->left));
+		}
+		return rotateRight(node);
+	}
+
+	assert(bf >= -1 and bf <= 1);
+	return node;
+}
+
+// Takes the reference to subtree that the caller holds and returns the new
+// subtree root, with the nodes on the path to key owned.
+template<typename K, typename V, typename A> 
+typename PersistentAVLDict<K, V, A>::Node* PersistentAVLDict<K, V, A>::insertNode(Node* subtree, const K& key, const V& val) {
+	if (subtree == nullptr) {
+		count++;
+		return create_node(key, val);
+	}
+
+	subtree = own(subtree);
+	if (key < subtree->key) {
+		subtree->left = insertNode(subtree->left, key, val);
+	} else if (subtree->key < key) {
+		subtree->right = insertNode(subtree->right, key, val);
+	} else {
+		subtree->val = val;
+		return subtree;
+	}
+
+	return rebalance(subtree);
+}
+
+// as insertNode(), key is in subtree
+template<typename K, typename V, typename A> 
+typename PersistentAVLDict<K, V, A>::Node* PersistentAVLDict<K, V, A>::eraseNode(Node* subtree, const K& key) {
+	if (key < subtree->key) {
+		subtree = own(subtree);
+		subtree->left = eraseNode(subtree->left, key);
+	} else if (subtree->key < key) {
+		subtree = own(subtree);
+		subtree->right = eraseNode(subtree->right, key);
+	} else if (subtree->left == nullptr or subtree->right == nullptr) {
+		// the child takes the place of the node, which other versions may
+		// still use
+		Node* child = retain(subtree->left != nullptr ? subtree->left : subtree->right);
+		release(subtree);
+		return child;
+	} else {
+		// the successor's entry moves up and the successor is erased
+		subtree = own(subtree);
+		Node* next = subtree->right;
+		while (next->left != nullptr) {
+			next = next->left;
+		}
+		subtree->key = next->key;
+		subtree->val = next->val;
+		subtree->right = eraseNode(subtree->right, subtree->key);
+	}
+
+	return rebalance(subtree);
+}
+
+
+template<typename K, typename V, typename A> 
+const std::pair<const K&, const V&> PersistentAVLDict<K, V, A>::ConstIterator::operator*() const {
+	Node* current = pending.back();
+	return std::pair<const K&, const V&>(current->key, current->val);
+}
+
+template<typename K, typename V, typename A> 
+typename PersistentAVLDict<K, V, A>::ConstIterator& PersistentAVLDict<K, V, A>::ConstIterator::operator++ (int) {
+	Node* current = pending.back();
+	pending.pop_back();
+	pushLeft(current->right);
+	return *this;
+}
+
+template<typename K, typename V, typename A> 
+bool PersistentAVLDict<K, V, A>::ConstIterator::operator== (const ConstIterator& const_it) const {
+	if (pending.empty() or const_it.pending.empty()) {
+		return pending.empty() and const_it.pending.empty();
+	}
+	return pending.back() == const_it.pending.back();
+}
+
+template<typename K, typename V, typename A> 
+bool PersistentAVLDict<K, V, A>::ConstIterator::operator!= (const ConstIterator& const_it) const {
+	return !(*this == const_it);
+}
+
+template<typename K, typename V, typename A> 
+void PersistentAVLDict<K, V, A>::ConstIterator::pushLeft(Node* subtree) {
+	while (subtree != nullptr) {
+		pending.push_back(subtree);
+		subtree = subtree->left;
+	}
+}
+
+}
+
+#endif
@@ -0,0 +1,712 @@
+#ifndef B_PLUS_TREE_H_
+#define B_PLUS_TREE_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "../pool_allocator/pool_allocator.hpp"
+
+namespace dicts {
+
+namespace internal {
+
+// Entries of entry_size bytes that fit in bytes, less the one a node holds
+// for a moment before it is split, and never fewer than 3.
+constexpr int b_plus_tree_slots(size_t bytes, size_t entry_size) {
+  return bytes / entry_size > 4 ? static_cast<int>(bytes / entry_size) - 1 : 3;
+}
+
+// Asks for all the cache lines of a node at once, so that the search
+// inside it waits for one miss instead of one per line it reads.
+inline void prefetch_node(const void* node, size_t bytes) {
+#if defined(__GNUC__)
+  for (size_t offset = 0; offset < bytes; offset += 64) {
+    __builtin_prefetch(static_cast<const char*>(node) + offset);
+  }
+#else
+  (void) node;
+  (void) bytes;
+#endif
+}
+
+}
+
+// Ordered dictionary kept in a B+ tree. Every node takes about NodeBytes
+// bytes (eight cache lines by default) and holds many sorted keys, so a
+// lookup touches log_b(n) nodes instead of the log2(n) of a binary tree.
+// Entries live in the leaves, which are linked in key order, so iteration
+// reads them one after the other.
+template<typename K, typename V, typename A = std::allocator<std::pair<const K, V> >, size_t NodeBytes = 512>
+class BPlusTreeDict {
+  private:
+    struct Node; //Forward declaration
+    struct Leaf;
+
+  public:
+    class ConstIterator {
+      public:
+        const std::pair<K&, V&> operator*() const;
+
+        ConstIterator& operator++ (int);
+
+        ConstIterator& operator= (const ConstIterator& const_it);
+
+        bool operator== (const ConstIterator& const_it) const;
+
+        bool operator!= (const ConstIterator& const_it) const;
+
+        ConstIterator(Leaf* l, int i){
+          leaf = l;
+          index = i;
+        }
+
+      private:
+        Leaf* leaf;
+        int index;
+    };
+
+
+    BPlusTreeDict();
+
+    // nodes are allocated with alloc, e.g. a PoolAllocator
+    explicit BPlusTreeDict(const A& alloc);
+
+    BPlusTreeDict(const BPlusTreeDict& dict);
+
+    ~BPlusTreeDict();
+
+    bool exists(const K& key) const;
+
+    V& get(const K& key);
+
+    void set(const K& key, const V& val);
+
+    void erase(const K& key);
+
+    BPlusTreeDict& operator= (const BPlusTreeDict& dict);
+
+    ConstIterator begin() const;
+
+    ConstIterator end() const;
+
+    // first entry whose key is not below key, or end()
+    ConstIterator lower_bound(const K& key) const;
+
+    // first entry whose key is above key, or end()
+    ConstIterator upper_bound(const K& key) const;
+
+    std::pair<ConstIterator, ConstIterator> equal_range(const K& key) const;
+
+    // Calls fn(key, val) on the entries with lo <= key < hi in key order
+    // until fn returns false. One descent finds lo, then the entries are
+    // read off the linked leaves.
+    template<typename F>
+    void for_each_in_range(const K& lo, const K& hi, F fn) const;
+
+
+  private:
+    static_assert(NodeBytes >= 64, "nodes need room for a few entries");
+
+    enum {
+      kLeafSlots = internal::b_plus_tree_slots(NodeBytes - 2 * sizeof(void*), sizeof(K) + sizeof(V)),
+      kInnerSlots = internal::b_plus_tree_slots(NodeBytes - 3 * sizeof(void*), sizeof(K) + sizeof(void*)),
+
+      // nodes other than the root are kept at least half full
+      kMinLeaf = kLeafSlots / 2,
+      kMinInner = kInnerSlots / 2
+    };
+
+    struct Node {
+      int count;
+      bool is_leaf;
+
+      explicit Node(bool leaf) {
+        count = 0;
+        is_leaf = leaf;
+      }
+    };
+
+    // count entries sorted by key, one more fits while the leaf overflows
+    struct Leaf : Node {
+      Leaf* next;
+
+      K keys[kLeafSlots + 1];
+      V vals[kLeafSlots + 1];
+
+      Leaf(): Node(true) {
+        next = nullptr;
+      }
+    };
+
+    // children[i] holds the keys below keys[i], children[i + 1] the rest
+    struct Inner : Node {
+      K keys[kInnerSlots + 1];
+      Node* children[kInnerSlots + 2];
+
+      Inner(): Node(false) {}
+    };
+
+    // leaves and inner nodes share one block size, so that a pool allocator
+    // serves both
+    typedef typename std::aligned_storage<(sizeof(Leaf) > sizeof(Inner) ? sizeof(Leaf) : sizeof(Inner)),
+                                          (alignof(Leaf) > alignof(Inner) ? alignof(Leaf) : alignof(Inner))>::type Block;
+
+    typedef typename std::allocator_traits<A>::template rebind_alloc<Block> NodeAllocator;
+    typedef std::allocator_traits<NodeAllocator> NodeTraits;
+
+    static void printNode(std::ostream& os, Node* node, std::string prefix, bool isTail);
+
+    // first entry not below key
+    static int lowerIndex(const K* keys, int count, const K& key);
+
+    // first entry above key, for an inner node the child whose subtree may
+    // hold key
+    static int upperIndex(const K* keys, int count, const K& key);
+
+    // iterator to entry i of leaf, which may be one past its last entry
+    static ConstIterator position(Leaf* leaf, int i);
+
+    Leaf* findLeaf(const K& key) const;
+
+    bool insert(Node* node, const K& key, const V& val);
+
+    bool erase(Node* node, const K& key);
+
+    void splitChild(Inner* parent, int i);
+
+    void fixUnderflow(Inner* parent, int i);
+
+    void mergeChildren(Inner* parent, int i);
+
+    Leaf* create_leaf();
+
+    Inner* create_inner();
+
+    void destroy_node(Node* node);
+
+    void destroy_subtree(Node* node);
+
+    Node* root;
+
+    NodeAllocator node_alloc;
+
+  friend class ConstIterator;
+
+  friend std::ostream& operator<< (std::ostream& os, const BPlusTreeDict<K, V, A, NodeBytes>& dict){
+    printNode(os, dict.root, "", true);
+    return os;
+  }
+
+};
+
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+BPlusTreeDict<K, V, A, NodeBytes>::BPlusTreeDict() {
+  root = nullptr;
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+BPlusTreeDict<K, V, A, NodeBytes>::BPlusTreeDict(const A& alloc): node_alloc(alloc) {
+  root = nullptr;
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+BPlusTreeDict<K, V, A, NodeBytes>::BPlusTreeDict(const BPlusTreeDict& dict):
+                node_alloc(NodeTraits::select_on_container_copy_construction(dict.node_alloc)) {
+  root = nullptr;
+  for (ConstIterator it = dict.begin(); it != dict.end(); it++) {
+    set((*it).first, (*it).second);
+  }
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+BPlusTreeDict<K, V, A, NodeBytes>::~BPlusTreeDict() {
+  // nodes that need no destructor are left to an allocator that frees
+  // them in bulk, e.g. a PoolAllocator that no one else uses
+  if (std::is_trivially_destructible<Leaf>::value and std::is_trivially_destructible<Inner>::value
+      and internal::releases_in_bulk(node_alloc)) {
+    return;
+  }
+
+  destroy_subtree(root);
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+BPlusTreeDict<K, V, A, NodeBytes>& BPlusTreeDict<K, V, A, NodeBytes>::operator=(const BPlusTreeDict& dict) {
+  if (this != &dict) {
+    destroy_subtree(root);
+    root = nullptr;
+    for (ConstIterator it = dict.begin(); it != dict.end(); it++) {
+      set((*it).first, (*it).second);
+    }
+  }
+
+  return *this;
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+bool BPlusTreeDict<K, V, A, NodeBytes>::exists(const K& key) const {
+  Leaf* leaf = findLeaf(key);
+  if (leaf == nullptr) {
+    return false;
+  }
+
+  int i = lowerIndex(leaf->keys, leaf->count, key);
+  return i < leaf->count and leaf->keys[i] == key;
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+V& BPlusTreeDict<K, V, A, NodeBytes>::get(const K& key) {
+  Leaf* leaf = findLeaf(key);
+  assert(leaf != nullptr);
+
+  int i = lowerIndex(leaf->keys, leaf->count, key);
+  assert(i < leaf->count and leaf->keys[i] == key);
+  return leaf->vals[i];
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+void BPlusTreeDict<K, V, A, NodeBytes>::set(const K& key, const V& val) {
+  if (root == nullptr) {
+    root = create_leaf();
+  }
+
+  insert(root, key, val);
+
+  // the tree grows at the root, so all the leaves stay at the same depth
+  if (root->count > (root->is_leaf ? kLeafSlots : kInnerSlots)) {
+    Inner* new_root = create_inner();
+    new_root->children[0] = root;
+    root = new_root;
+    splitChild(new_root, 0);
+  }
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+void BPlusTreeDict<K, V, A, NodeBytes>::erase(const K& key) {
+  if (root == nullptr or !erase(root, key)) {
+    return;
+  }
+
+  // the tree shrinks at the root
+  if (root->count == 0) {
+    Node* old_root = root;
+    root = root->is_leaf ? nullptr : static_cast<Inner*>(root)->children[0];
+    destroy_node(old_root);
+  }
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+typename BPlusTreeDict<K, V, A, NodeBytes>::ConstIterator BPlusTreeDict<K, V, A, NodeBytes>::begin() const {
+  if (root == nullptr) {
+    return end();
+  }
+
+  Node* node = root;
+  while (!node->is_leaf) {
+    node = static_cast<Inner*>(node)->children[0];
+  }
+
+  return ConstIterator(static_cast<Leaf*>(node), 0);
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+typename BPlusTreeDict<K, V, A, NodeBytes>::ConstIterator BPlusTreeDict<K, V, A, NodeBytes>::end() const {
+  return ConstIterator(nullptr, 0);
+}
+
+// The leaf reached by key holds the bounds, unless they are all below key,
+// then the bound is the first entry of the next leaf.
+template<typename K, typename V, typename A, size_t NodeBytes>
+typename BPlusTreeDict<K, V, A, NodeBytes>::ConstIterator BPlusTreeDict<K, V, A, NodeBytes>::lower_bound(const K& key) const {
+  Leaf* leaf = findLeaf(key);
+  return position(leaf, leaf == nullptr ? 0 : lowerIndex(leaf->keys, leaf->count, key));
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+typename BPlusTreeDict<K, V, A, NodeBytes>::ConstIterator BPlusTreeDict<K, V, A, NodeBytes>::upper_bound(const K& key) const {
+  Leaf* leaf = findLeaf(key);
+  return position(leaf, leaf == nullptr ? 0 : upperIndex(leaf->keys, leaf->count, key));
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+std::pair<typename BPlusTreeDict<K, V, A, NodeBytes>::ConstIterator, typename BPlusTreeDict<K, V, A, NodeBytes>::ConstIterator>
+BPlusTreeDict<K, V, A, NodeBytes>::equal_range(const K& key) const {
+  return std::make_pair(lower_bound(key), upper_bound(key));
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+template<typename F>
+void BPlusTreeDict<K, V, A, NodeBytes>::for_each_in_range(const K& lo, const K& hi, F fn) const {
+  Leaf* leaf = findLeaf(lo);
+  if (leaf == nullptr) {
+    return;
+  }
+
+  for (int i = lowerIndex(leaf->keys, leaf->count, lo); leaf != nullptr; leaf = leaf->next, i = 0) {
+    for (; i < leaf->count; i++) {
+      if (!(leaf->keys[i] < hi) or !fn(leaf->keys[i], leaf->vals[i])) {
+        return;
+      }
+    }
+  }
+}
+
+// The searches halve the range without branching on the comparisons, which
+// would be mispredicted half of the time on every level.
+template<typename K, typename V, typename A, size_t NodeBytes>
+int BPlusTreeDict<K, V, A, NodeBytes>::lowerIndex(const K* keys, int count, const K& key) {
+  if (count == 0) {
+    return 0;
+  }
+
+  const K* base = keys;
+  while (count > 1) {
+    int half = count / 2;
+    base = base[half - 1] < key ? base + half : base;
+    count -= half;
+  }
+  return static_cast<int>(base - keys) + (*base < key ? 1 : 0);
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+int BPlusTreeDict<K, V, A, NodeBytes>::upperIndex(const K* keys, int count, const K& key) {
+  if (count == 0) {
+    return 0;
+  }
+
+  const K* base = keys;
+  while (count > 1) {
+    int half = count / 2;
+    base = key < base[half - 1] ? base : base + half;
+    count -= half;
+  }
+  return static_cast<int>(base - keys) + (key < *base ? 0 : 1);
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+typename BPlusTreeDict<K, V, A, NodeBytes>::ConstIterator BPlusTreeDict<K, V, A, NodeBytes>::position(Leaf* leaf, int i) {
+  if (leaf != nullptr and i == leaf->count) {
+    leaf = leaf->next;
+    i = 0;
+  }
+  return leaf == nullptr ? ConstIterator(nullptr, 0) : ConstIterator(leaf, i);
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+typename BPlusTreeDict<K, V, A, NodeBytes>::Leaf* BPlusTreeDict<K, V, A, NodeBytes>::findLeaf(const K& key) const {
+  Node* node = root;
+  while (node != nullptr and !node->is_leaf) {
+    Inner* inner = static_cast<Inner*>(node);
+    node = inner->children[upperIndex(inner->keys, inner->count, key)];
+    internal::prefetch_node(node, sizeof(Block));
+  }
+  return static_cast<Leaf*>(node);
+}
+
+// Returns whether key was new. A node may be left with one entry too many,
+// its parent splits it.
+template<typename K, typename V, typename A, size_t NodeBytes>
+bool BPlusTreeDict<K, V, A, NodeBytes>::insert(Node* node, const K& key, const V& val) {
+  if (node->is_leaf) {
+    Leaf* leaf = static_cast<Leaf*>(node);
+    int i = lowerIndex(leaf->keys, leaf->count, key);
+    if (i < leaf->count and leaf->keys[i] == key) {
+      leaf->vals[i] = val;
+      return false;
+    }
+
+    std::move_backward(leaf->keys + i, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+    std::move_backward(leaf->vals + i, leaf->vals + leaf->count, leaf->vals + leaf->count + 1);
+    leaf->keys[i] = key;
+    leaf->vals[i] = val;
+    leaf->count++;
+    return true;
+  }
+
+  Inner* inner = static_cast<Inner*>(node);
+  int i = upperIndex(inner->keys, inner->count, key);
+  Node* child = inner->children[i];
+  internal::prefetch_node(child, sizeof(Block));
+  bool inserted = insert(child, key, val);
+  if (child->count > (child->is_leaf ? kLeafSlots : kInnerSlots)) {
+    splitChild(inner, i);
+  }
+  return inserted;
+}
+
+// Returns whether key was there. A node may be left with too few entries,
+// its parent refills it.
+template<typename K, typename V, typename A, size_t NodeBytes>
+bool BPlusTreeDict<K, V, A, NodeBytes>::erase(Node* node, const K& key) {
+  if (node->is_leaf) {
+    Leaf* leaf = static_cast<Leaf*>(node);
+    int i = lowerIndex(leaf->keys, leaf->count, key);
+    if (i == leaf->count or !(leaf->keys[i] == key)) {
+      return false;
+    }
+
+    std::move(leaf->keys + i + 1, leaf->keys + leaf->count, leaf->keys + i);
+    std::move(leaf->vals + i + 1, leaf->vals + leaf->count, leaf->vals + i);
+    leaf->count--;
+    return true;
+  }
+
+  Inner* inner = static_cast<Inner*>(node);
+  int i = upperIndex(inner->keys, inner->count, key);
+  Node* child = inner->children[i];
+  internal::prefetch_node(child, sizeof(Block));
+  if (!erase(child, key)) {
+    return false;
+  }
+
+  if (child->count < (child->is_leaf ? kMinLeaf : kMinInner)) {
+    fixUnderflow(inner, i);
+  }
+  return true;
+}
+
+// Splits the overflowing child i of parent in two halves.
+template<typename K, typename V, typename A, size_t NodeBytes>
+void BPlusTreeDict<K, V, A, NodeBytes>::splitChild(Inner* parent, int i) {
+  Node* child = parent->children[i];
+  Node* sibling;
+  K separator;
+
+  if (child->is_leaf) {
+    Leaf* left = static_cast<Leaf*>(child);
+    Leaf* right = create_leaf();
+    int mid = (left->count + 1) / 2;
+
+    std::move(left->keys + mid, left->keys + left->count, right->keys);
+    std::move(left->vals + mid, left->vals + left->count, right->vals);
+    right->count = left->count - mid;
+    left->count = mid;
+
+    right->next = left->next;
+    left->next = right;
+
+    // leaves keep all the keys, the parent gets a copy of the first one
+    separator = right->keys[0];
+    sibling = right;
+  } else {
+    Inner* left = static_cast<Inner*>(child);
+    Inner* right = create_inner();
+    int mid = left->count / 2;
+
+    std::move(left->keys + mid + 1, left->keys + left->count, right->keys);
+    std::copy(left->children + mid + 1, left->children + left->count + 1, right->children);
+    right->count = left->count - mid - 1;
+    left->count = mid;
+
+    // the middle key moves up
+    separator = std::move(left->keys[mid]);
+    sibling = right;
+  }
+
+  std::move_backward(parent->keys + i, parent->keys + parent->count, parent->keys + parent->count + 1);
+  std::copy_backward(parent->children + i + 1, parent->children + parent->count + 1,
+                     parent->children + parent->count + 2);
+  parent->keys[i] = std::move(separator);
+  parent->children[i + 1] = sibling;
+  parent->count++;
+}
+
+// Refills child i of parent with an entry of a sibling that can spare one,
+// or merges it with a sibling.
+template<typename K, typename V, typename A, size_t NodeBytes>
+void BPlusTreeDict<K, V, A, NodeBytes>::fixUnderflow(Inner* parent, int i) {
+  Node* child = parent->children[i];
+  int min_count = child->is_leaf ? kMinLeaf : kMinInner;
+  Node* left_node = i > 0 ? parent->children[i - 1] : nullptr;
+  Node* right_node = i < parent->count ? parent->children[i + 1] : nullptr;
+
+  if (left_node != nullptr and left_node->count > min_count) {
+    if (child->is_leaf) {
+      Leaf* left = static_cast<Leaf*>(left_node);
+      Leaf* leaf = static_cast<Leaf*>(child);
+      std::move_backward(leaf->keys, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+      std::move_backward(leaf->vals, leaf->vals + leaf->count, leaf->vals + leaf->count + 1);
+      leaf->keys[0] = std::move(left->keys[left->count - 1]);
+      leaf->vals[0] = std::move(left->vals[left->count - 1]);
+      parent->keys[i - 1] = leaf->keys[0];
+    } else {
+      Inner* left = static_cast<Inner*>(left_node);
+      Inner* inner = static_cast<Inner*>(child);
+      std::move_backward(inner->keys, inner->keys + inner->count, inner->keys + inner->count + 1);
+      std::copy_backward(inner->children, inner->children + inner->count + 1, inner->children + inner->count + 2);
+      inner->keys[0] = std::move(parent->keys[i - 1]);
+      inner->children[0] = left->children[left->count];
+      parent->keys[i - 1] = std::move(left->keys[left->count - 1]);
+    }
+    left_node->count--;
+    child->count++;
+  } else if (right_node != nullptr and right_node->count > min_count) {
+    if (child->is_leaf) {
+      Leaf* right = static_cast<Leaf*>(right_node);
+      Leaf* leaf = static_cast<Leaf*>(child);
+      leaf->keys[leaf->count] = std::move(right->keys[0]);
+      leaf->vals[leaf->count] = std::move(right->vals[0]);
+      std::move(right->keys + 1, right->keys + right->count, right->keys);
+      std::move(right->vals + 1, right->vals + right->count, right->vals);
+      parent->keys[i] = right->keys[0];
+    } else {
+      Inner* right = static_cast<Inner*>(right_node);
+      Inner* inner = static_cast<Inner*>(child);
+      inner->keys[inner->count] = std::move(parent->keys[i]);
+      inner->children[inner->count + 1] = right->children[0];
+      parent->keys[i] = std::move(right->keys[0]);
+      std::move(right->keys + 1, right->keys + right->count, right->keys);
+      std::copy(right->children + 1, right->children + right->count + 1, right->children);
+    }
+    right_node->count--;
+    child->count++;
+  } else if (left_node != nullptr) {
+    mergeChildren(parent, i - 1);
+  } else {
+    mergeChildren(parent, i);
+  }
+}
+
+// Moves child i + 1 of parent into child i and frees it.
+template<typename K, typename V, typename A, size_t NodeBytes>
+void BPlusTreeDict<K, V, A, NodeBytes>::mergeChildren(Inner* parent, int i) {
+  Node* left_node = parent->children[i];
+  Node* right_node = parent->children[i + 1];
+
+  if (left_node->is_leaf) {
+    Leaf* left = static_cast<Leaf*>(left_node);
+    Leaf* right = static_cast<Leaf*>(right_node);
+    std::move(right->keys, right->keys + right->count, left->keys + left->count);
+    std::move(right->vals, right->vals + right->count, left->vals + left->count);
+    left->count += right->count;
+    left->next = right->next;
+  } else {
+    Inner* left = static_cast<Inner*>(left_node);
+    Inner* right = static_cast<Inner*>(right_node);
+    left->keys[left->count] = std::move(parent->keys[i]);
+    std::move(right->keys, right->keys + right->count, left->keys + left->count + 1);
+    std::copy(right->children, right->children + right->count + 1, left->children + left->count + 1);
+    left->count += right->count + 1;
+  }
+
+  std::move(parent->keys + i + 1, parent->keys + parent->count, parent->keys + i);
+  std::copy(parent->children + i + 2, parent->children + parent->count + 1, parent->children + i + 1);
+  parent->count--;
+
+  destroy_node(right_node);
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+typename BPlusTreeDict<K, V, A, NodeBytes>::Leaf* BPlusTreeDict<K, V, A, NodeBytes>::create_leaf() {
+  Block* block = NodeTraits::allocate(node_alloc, 1);
+  return ::new (static_cast<void*>(block)) Leaf();
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+typename BPlusTreeDict<K, V, A, NodeBytes>::Inner* BPlusTreeDict<K, V, A, NodeBytes>::create_inner() {
+  Block* block = NodeTraits::allocate(node_alloc, 1);
+  return ::new (static_cast<void*>(block)) Inner();
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+void BPlusTreeDict<K, V, A, NodeBytes>::destroy_node(Node* node) {
+  if (node->is_leaf) {
+    static_cast<Leaf*>(node)->~Leaf();
+  } else {
+    static_cast<Inner*>(node)->~Inner();
+  }
+  NodeTraits::deallocate(node_alloc, reinterpret_cast<Block*>(node), 1);
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+void BPlusTreeDict<K, V, A, NodeBytes>::destroy_subtree(Node* node) {
+  if (node == nullptr) {
+    return;
+  }
+
+  // recursion goes as deep as the tree, a handful of levels
+  if (!node->is_leaf) {
+    Inner* inner = static_cast<Inner*>(node);
+    for (int i = 0; i <= inner->count; i++) {
+      destroy_subtree(inner->children[i]);
+    }
+  }
+  destroy_node(node);
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+const std::pair<K&, V&> BPlusTreeDict<K, V, A, NodeBytes>::ConstIterator::operator*() const {
+  std::pair<K&, V&> res {leaf->keys[index], leaf->vals[index]};
+  return res;
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+typename BPlusTreeDict<K, V, A, NodeBytes>::ConstIterator&
+BPlusTreeDict<K, V, A, NodeBytes>::ConstIterator::operator=(const ConstIterator& it) {
+  leaf = it.leaf;
+  index = it.index;
+
+  return *this;
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+bool BPlusTreeDict<K, V, A, NodeBytes>::ConstIterator::operator==(const ConstIterator& it) const {
+  return (leaf == it.leaf and index == it.index);
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+bool BPlusTreeDict<K, V, A, NodeBytes>::ConstIterator::operator!=(const ConstIterator& it) const {
+  return !(*this == it);
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+typename BPlusTreeDict<K, V, A, NodeBytes>::ConstIterator&
+BPlusTreeDict<K, V, A, NodeBytes>::ConstIterator::operator++(int) {
+  index++;
+  if (index == leaf->count) {
+    // on to the next leaf, end() after the last one
+    leaf = leaf->next;
+    index = 0;
+  }
+
+  return *this;
+}
+
+template<typename K, typename V, typename A, size_t NodeBytes>
+void BPlusTreeDict<K, V, A, NodeBytes>::printNode(std::ostream& os, Node* node, std::string prefix, bool isTail) {
+  if (node == nullptr) {
+    return;
+  }
+
+  os << (prefix + (isTail ? "└── " : "├── ")) << "[";
+  if (node->is_leaf) {
+    Leaf* leaf = static_cast<Leaf*>(node);
+    for (int i = 0; i < leaf->count; i++) {
+      os << (i == 0 ? "" : " ") << leaf->keys[i];
+    }
+    os << "]" << std::endl;
+    return;
+  }
+
+  Inner* inner = static_cast<Inner*>(node);
+  for (int i = 0; i < inner->count; i++) {
+    os << (i == 0 ? "" : " ") << inner->keys[i];
+  }
+  os << "]" << std::endl;
+
+  for (int i = 0; i <= inner->count; i++) {
+    printNode(os, inner->children[i], (prefix + (isTail ? "    " : "│   ")), i == inner->count);
+  }
+}
+
+}
+
+#endif
@@ -0,0 +1,32 @@
+#include <iostream>
+#include "b_plus_tree.hpp"
+#include <string>
+
+int main(){
+  // small nodes so that the example tree has a few levels
+  dicts::BPlusTreeDict<int, std::string, std::allocator<std::pair<const int, std::string> >, 128> bt_dict;
+
+  for (int i = 0; i < 20; i++) {
+    bt_dict.set(i * 3 % 20, "baa");
+  }
+  bt_dict.set(-1, "aaa");
+  std::cout << bt_dict << std::endl;
+
+  bt_dict.erase(4);
+  bt_dict.erase(5);
+  bt_dict.erase(6);
+  std::cout << bt_dict << std::endl;
+
+  // the leaves are visited in key order
+  for (auto it = bt_dict.begin(); it != bt_dict.end(); it++) {
+    std::cout << (*it).first << " " << (*it).second << std::endl;
+  }
+
+  std::cout << bt_dict.exists(5) << " " << bt_dict.get(-1) << std::endl;
+
+  dicts::BPlusTreeDict<int, int, dicts::PoolAllocator<int> > pooled;
+  for (int i = 0; i < 100000; i++) {
+    pooled.set(i, i);
+  }
+  std::cout << pooled.get(4242) << std::endl;
+}
@@ -0,0 +1,778 @@
+#include "avl_tree.hpp"
+#include "b_plus_tree.hpp"
+#include "binary_search_tree.hpp"
+#include "cuckoo_hash_map.hpp"
+#include "hash_map.hpp"
+#include "persistent_avl_tree.hpp"
+#include "splay_tree.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/resource.h>
+
+// Runs the same workloads against every dictionary of the repository, with
+// std::map and std::unordered_map as baselines, and reports ns/op,
+// allocations/op and peak RSS of every run. The JSON output follows the
+// layout of Google Benchmark, so its comparison tools can diff two runs.
+//
+// Every benchmark is named dict/key type/distribution/workload/size:
+//   key types      int64 and string (20 characters, so never inline)
+//   distributions  sequential, uniform and zipf (theta 0.99) accesses
+//   workloads      insert    n keys into an empty dictionary
+//                  lookup    get() of keys that are present
+//                  erase     half of the keys
+//                  mixed     50% lookups, 25% inserts of new keys and 25%
+//                            erases of present keys
+//                  iterate   a scan over all the entries
+//                  range     scans of 100 entries from a drawn key, for the
+//                            ordered dictionaries
+// The trees also run with their nodes in a PoolAllocator ("+pool"). Small
+// sizes are repeated until --min-ops operations have been timed. The BST is
+// skipped on sequential keys above 10000, where it is a list.
+//
+// usage: dict_bench [--sizes=1000,10000,100000,1000000] [--filter=substring]
+//                   [--min-ops=1000000] [--json=path]
+
+namespace {
+
+std::atomic<uint64_t> g_allocations(0);
+
+}
+
+namespace {
+
+// Out of line, so that the compiler does not see the operator new below
+// paired with a free() once operator delete is inlined.
+__attribute__((noinline)) void* counted_malloc(size_t size, size_t align) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  void* ptr = nullptr;
+  if (align <= alignof(std::max_align_t)) {
+    ptr = std::malloc(size != 0 ? size : 1);
+  } else if (posix_memalign(&ptr, align, size != 0 ? size : 1) != 0) {
+    ptr = nullptr;
+  }
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+__attribute__((noinline)) void counted_free(void* ptr) {
+  std::free(ptr);
+}
+
+}
+
+// every allocation of the process goes through here and is counted, the
+// array and nothrow forms call these
+void* operator new(size_t size) {
+  return counted_malloc(size, alignof(std::max_align_t));
+}
+
+void operator delete(void* ptr) noexcept {
+  counted_free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  counted_free(ptr);
+}
+
+#ifdef __cpp_aligned_new
+// over-aligned types, from C++17 on
+void* operator new(size_t size, std::align_val_t align) {
+  return counted_malloc(size, static_cast<size_t>(align));
+}
+
+void* operator new[](size_t size, std::align_val_t align) {
+  return counted_malloc(size, static_cast<size_t>(align));
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+  counted_free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+  counted_free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+  counted_free(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+  counted_free(ptr);
+}
+#endif
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// Peak resident set size in bytes since the last reset_peak_rss. Linux
+// resets VmHWM through clear_refs, elsewhere the peak of the whole process
+// is reported.
+void reset_peak_rss() {
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  if (clear_refs) {
+    clear_refs << "5";
+  }
+}
+
+uint64_t peak_rss() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+    }
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+}
+
+// murmur3's finalizer, a bijection, so distinct inputs give distinct keys
+uint64_t scramble(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+// Zipfian ranks in [0, n), rank 0 being the most popular, with the method
+// of Gray et al. "Quickly generating billion-record synthetic databases"
+// used by YCSB. Setting it up is O(n), drawing is O(1).
+class Zipf {
+  public:
+    Zipf(uint64_t n, double theta): n_(n), theta_(theta), zetan_(0) {
+      for (uint64_t i = 1; i <= n_; i++) {
+        zetan_ += 1.0 / std::pow(static_cast<double>(i), theta_);
+      }
+      double zeta2 = 1.0 + 1.0 / std::pow(2.0, theta_);
+      alpha_ = 1.0 / (1.0 - theta_);
+      eta_ = (1.0 - std::pow(2.0 / n_, 1.0 - theta_)) / (1.0 - zeta2 / zetan_);
+    }
+
+    uint64_t next(std::mt19937_64& rng) {
+      double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+      double uz = u * zetan_;
+      if (uz < 1.0) {
+        return 0;
+      }
+      if (uz < 1.0 + std::pow(0.5, theta_)) {
+        return std::min<uint64_t>(1, n_ - 1);
+      }
+      uint64_t rank = static_cast<uint64_t>(n_ * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+      return std::min(rank, n_ - 1);
+    }
+
+  private:
+    uint64_t n_;
+    double theta_;
+    double zetan_;
+    double alpha_;
+    double eta_;
+};
+
+enum Distribution { kSequential, kUniform, kZipf };
+
+const char* distribution_name(Distribution dist) {
+  return dist == kSequential ? "sequential" : (dist == kUniform ? "uniform" : "zipf");
+}
+
+// Picks positions in [0, size) in the order of a distribution.
+class Picker {
+  public:
+    Picker(Distribution dist, uint64_t n): dist_(dist), cursor_(0), rng_(42) {
+      if (dist_ == kZipf) {
+        zipf_.reset(new Zipf(n, 0.99));
+      }
+    }
+
+    uint64_t next(uint64_t size) {
+      switch (dist_) {
+        case kSequential:
+          return cursor_++ % size;
+        case kUniform:
+          return rng_() % size;
+        default:
+          return zipf_->next(rng_) % size;
+      }
+    }
+
+    std::mt19937_64& rng() { return rng_; }
+
+  private:
+    Distribution dist_;
+    uint64_t cursor_;
+    std::mt19937_64 rng_;
+    std::unique_ptr<Zipf> zipf_;
+};
+
+template<typename K>
+struct KeyMaker;
+
+template<>
+struct KeyMaker<int64_t> {
+    static const char* name() { return "int64"; }
+
+    static int64_t make(uint64_t i, Distribution dist) {
+      return static_cast<int64_t>(dist == kSequential ? i : scramble(i));
+    }
+};
+
+template<>
+struct KeyMaker<std::string> {
+    static const char* name() { return "string"; }
+
+    static std::string make(uint64_t i, Distribution dist) {
+      char buffer[32];
+      std::snprintf(buffer, sizeof(buffer), "key:%016llx",
+                    static_cast<unsigned long long>(dist == kSequential ? i : scramble(i)));
+      return buffer;
+    }
+};
+
+// The dictionaries behind one interface. The repository ones share
+// set/get/erase and an iterator with a postfix ++.
+template<typename Dict>
+struct DictOps {
+    static const bool kIterable = true;
+
+    template<typename K>
+    static void insert(Dict& dict, const K& key, int64_t val) { dict.set(key, val); }
+
+    template<typename K>
+    static int64_t lookup(Dict& dict, const K& key) { return dict.get(key); }
+
+    template<typename K>
+    static void erase(Dict& dict, const K& key) { dict.erase(key); }
+
+    static int64_t scan(Dict& dict) {
+      int64_t sum = 0;
+      for (typename Dict::ConstIterator it = dict.begin(); it != dict.end(); it++) {
+        sum += (*it).second;
+      }
+      return sum;
+    }
+};
+
+template<typename K>
+struct DictOps<dicts::CuckooHashMap<K, int64_t> > {
+    typedef dicts::CuckooHashMap<K, int64_t> Dict;
+
+    static const bool kIterable = false;
+
+    static void insert(Dict& dict, const K& key, int64_t val) { dict.set(key, val); }
+
+    static int64_t lookup(Dict& dict, const K& key) { return dict.get(key); }
+
+    static void erase(Dict& dict, const K& key) { dict.erase(key); }
+
+    static int64_t scan(Dict&) { return 0; }
+};
+
+template<typename Dict>
+struct StdOps {
+    static const bool kIterable = true;
+
+    template<typename K>
+    static void insert(Dict& dict, const K& key, int64_t val) { dict[key] = val; }
+
+    template<typename K>
+    static int64_t lookup(Dict& dict, const K& key) { return dict.find(key)->second; }
+
+    template<typename K>
+    static void erase(Dict& dict, const K& key) { dict.erase(key); }
+
+    static int64_t scan(Dict& dict) {
+      int64_t sum = 0;
+      for (const auto& kv : dict) {
+        sum += kv.second;
+      }
+      return sum;
+    }
+};
+
+template<typename K>
+struct DictOps<std::map<K, int64_t> > : StdOps<std::map<K, int64_t> > {};
+
+template<typename K>
+struct DictOps<std::unordered_map<K, int64_t> > : StdOps<std::unordered_map<K, int64_t> > {};
+
+// Scans of the entries with lo <= key < hi, for the dictionaries that keep
+// their keys in order.
+template<typename Dict>
+struct RangeOps {
+    static const bool kOrdered = false;
+
+    template<typename K>
+    static int64_t scan(Dict&, const K&, const K&) { return 0; }
+};
+
+template<typename Dict>
+struct TreeRangeOps {
+    static const bool kOrdered = true;
+
+    template<typename K>
+    static int64_t scan(Dict& dict, const K& lo, const K& hi) {
+      int64_t sum = 0;
+      dict.for_each_in_range(lo, hi, [&sum](const K&, int64_t& val) {
+        sum += val;
+        return true;
+      });
+      return sum;
+    }
+};
+
+template<typename K, typename A>
+struct RangeOps<dicts::AVLDict<K, int64_t, A> > : TreeRangeOps<dicts::AVLDict<K, int64_t, A> > {};
+
+template<typename K, typename A>
+struct RangeOps<dicts::SplayDict<K, int64_t, A> > : TreeRangeOps<dicts::SplayDict<K, int64_t, A> > {};
+
+template<typename K, typename A>
+struct RangeOps<dicts::BST<K, int64_t, A> > : TreeRangeOps<dicts::BST<K, int64_t, A> > {};
+
+template<typename K, typename A, size_t NodeBytes>
+struct RangeOps<dicts::BPlusTreeDict<K, int64_t, A, NodeBytes> >
+    : TreeRangeOps<dicts::BPlusTreeDict<K, int64_t, A, NodeBytes> > {};
+
+template<typename K>
+struct RangeOps<std::map<K, int64_t> > {
+    static const bool kOrdered = true;
+
+    static int64_t scan(std::map<K, int64_t>& dict, const K& lo, const K& hi) {
+      int64_t sum = 0;
+      for (auto it = dict.lower_bound(lo); it != dict.end() and it->first < hi; ++it) {
+        sum += it->second;
+      }
+      return sum;
+    }
+};
+
+struct Result {
+    std::string name;
+    uint64_t ops;
+    double ns;
+    uint64_t allocations;
+    uint64_t peak_rss;
+};
+
+// Times the operations between start() and stop(), several spans add up.
+class Timer {
+  public:
+    Timer(): ns_(0), allocations_(0), start_allocations_(0) {}
+
+    void start() {
+      start_allocations_ = g_allocations.load(std::memory_order_relaxed);
+      start_ = Clock::now();
+    }
+
+    void stop() {
+      ns_ += std::chrono::duration<double, std::nano>(Clock::now() - start_).count();
+      allocations_ += g_allocations.load(std::memory_order_relaxed) - start_allocations_;
+    }
+
+    double ns() const { return ns_; }
+
+    uint64_t allocations() const { return allocations_; }
+
+  private:
+    Clock::time_point start_;
+    double ns_;
+    uint64_t allocations_;
+    uint64_t start_allocations_;
+};
+
+// keeps results from being optimised away
+int64_t g_sink = 0;
+
+template<typename Dict, typename K>
+class Runner {
+  public:
+    typedef DictOps<Dict> Ops;
+
+    Runner(Distribution dist, uint64_t n, uint64_t min_ops): dist_(dist), n_(n), min_ops_(min_ops) {
+      // a sequential load is inserted in order, the others in random order
+      keys_.reserve(n_);
+      for (uint64_t i = 0; i < n_; i++) {
+        keys_.push_back(KeyMaker<K>::make(i, dist_));
+      }
+    }
+
+    uint64_t reps(uint64_t ops_per_rep) const {
+      return std::max<uint64_t>(1, (min_ops_ + ops_per_rep - 1) / ops_per_rep);
+    }
+
+    std::unique_ptr<Dict> build() const {
+      std::unique_ptr<Dict> dict(new Dict());
+      for (uint64_t i = 0; i < n_; i++) {
+        Ops::insert(*dict, keys_[i], static_cast<int64_t>(i));
+      }
+      return dict;
+    }
+
+    // keys of n draws of the distribution over the loaded keys
+    std::vector<K> draw(uint64_t count) const {
+      Picker picker(dist_, n_);
+      std::vector<K> drawn;
+      drawn.reserve(count);
+      for (uint64_t i = 0; i < count; i++) {
+        drawn.push_back(keys_[picker.next(n_)]);
+      }
+      return drawn;
+    }
+
+    uint64_t insert(Timer* timer) {
+      // keys repeat under zipf, so some of the inserts are updates
+      std::vector<K> inserted = dist_ == kZipf ? draw(n_) : keys_;
+
+      for (uint64_t r = 0; r < reps(n_); r++) {
+        std::unique_ptr<Dict> dict(new Dict());
+        timer->start();
+        for (uint64_t i = 0; i < n_; i++) {
+          Ops::insert(*dict, inserted[i], static_cast<int64_t>(i));
+        }
+        timer->stop();
+      }
+      return reps(n_) * n_;
+    }
+
+    uint64_t lookup(Timer* timer) {
+      std::unique_ptr<Dict> dict = build();
+      std::vector<K> queries = draw(std::max(n_, min_ops_));
+
+      int64_t sum = 0;
+      timer->start();
+      for (const K& key : queries) {
+        sum += Ops::lookup(*dict, key);
+      }
+      timer->stop();
+
+      g_sink += sum;
+      return queries.size();
+    }
+
+    uint64_t erase(Timer* timer) {
+      // half of the keys, in the order of the distribution under sequential
+      // and uniform, by popularity under zipf
+      std::vector<K> erased;
+      if (dist_ == kSequential) {
+        for (uint64_t i = 0; i < n_; i += 2) {
+          erased.push_back(keys_[i]);
+        }
+      } else {
+        std::vector<uint64_t> order(n_);
+        for (uint64_t i = 0; i < n_; i++) {
+          order[i] = i;
+        }
+        if (dist_ == kUniform) {
+          std::mt19937_64 rng(7);
+          std::shuffle(order.begin(), order.end(), rng);
+        }
+        for (uint64_t i = 0; i < n_ / 2; i++) {
+          erased.push_back(keys_[order[i]]);
+        }
+      }
+
+      for (uint64_t r = 0; r < reps(erased.size()); r++) {
+        std::unique_ptr<Dict> dict = build();
+        timer->start();
+        for (const K& key : erased) {
+          Ops::erase(*dict, key);
+        }
+        timer->stop();
+      }
+      return reps(erased.size()) * erased.size();
+    }
+
+    uint64_t mixed(Timer* timer) {
+      enum OpType { kLookup, kInsert, kErase };
+      struct Op {
+          OpType type;
+          K key;
+      };
+
+      // the operations are simulated up front so that lookups and erases
+      // only hit present keys, and the size stays around n
+      std::vector<K> present = keys_;
+      uint64_t next_key = n_;
+      Picker picker(dist_, n_);
+      std::vector<Op> ops;
+      uint64_t count = std::max(n_, min_ops_);
+      ops.reserve(count);
+
+      for (uint64_t i = 0; i < count; i++) {
+        uint64_t r = picker.rng()() % 4;
+        if (r < 2 or (r == 3 and present.size() <= 1)) {
+          ops.push_back(Op{kLookup, present[picker.next(present.size())]});
+        } else if (r == 2) {
+          K key = KeyMaker<K>::make(next_key++, dist_);
+          ops.push_back(Op{kInsert, key});
+          present.push_back(key);
+        } else {
+          uint64_t idx = picker.next(present.size());
+          ops.push_back(Op{kErase, present[idx]});
+          present[idx] = present.back();
+          present.pop_back();
+        }
+      }
+
+      std::unique_ptr<Dict> dict = build();
+      int64_t sum = 0;
+      timer->start();
+      for (const Op& op : ops) {
+        switch (op.type) {
+          case kLookup:
+            sum += Ops::lookup(*dict, op.key);
+            break;
+          case kInsert:
+            Ops::insert(*dict, op.key, 1);
+            break;
+          case kErase:
+            Ops::erase(*dict, op.key);
+            break;
+        }
+      }
+      timer->stop();
+
+      g_sink += sum;
+      return ops.size();
+    }
+
+    uint64_t iterate(Timer* timer) {
+      std::unique_ptr<Dict> dict = build();
+
+      int64_t sum = 0;
+      for (uint64_t r = 0; r < reps(n_); r++) {
+        timer->start();
+        sum += Ops::scan(*dict);
+        timer->stop();
+      }
+
+      g_sink += sum;
+      return reps(n_) * n_;
+    }
+
+    uint64_t range(Timer* timer) {
+      const uint64_t kRangeLength = 100;
+
+      // bounds kRangeLength loaded keys apart, the first one drawn from the
+      // distribution over the sorted keys
+      std::vector<K> sorted = keys_;
+      std::sort(sorted.begin(), sorted.end());
+      Picker picker(dist_, n_);
+      std::vector<std::pair<K, K> > bounds;
+      uint64_t count = std::max<uint64_t>(1, std::max(n_, min_ops_) / kRangeLength);
+      bounds.reserve(count);
+      for (uint64_t i = 0; i < count; i++) {
+        uint64_t first = picker.next(n_);
+        bounds.push_back(std::make_pair(sorted[first], sorted[std::min(first + kRangeLength, n_ - 1)]));
+      }
+
+      std::unique_ptr<Dict> dict = build();
+      int64_t sum = 0;
+      timer->start();
+      for (const std::pair<K, K>& bound : bounds) {
+        sum += RangeOps<Dict>::scan(*dict, bound.first, bound.second);
+      }
+      timer->stop();
+
+      g_sink += sum;
+      return bounds.size();
+    }
+
+  private:
+    Distribution dist_;
+    uint64_t n_;
+    uint64_t min_ops_;
+    std::vector<K> keys_;
+};
+
+struct Options {
+    std::vector<uint64_t> sizes;
+    std::string filter;
+    uint64_t min_ops;
+    std::string json_path;
+};
+
+class Suite {
+  public:
+    explicit Suite(const Options& options): options_(options) {}
+
+    template<typename Dict, typename K>
+    void run(const char* dict_name) {
+      const Distribution dists[] = {kSequential, kUniform, kZipf};
+      const char* workloads[] = {"insert", "lookup", "erase", "mixed", "iterate", "range"};
+
+      for (Distribution dist : dists) {
+        for (uint64_t n : options_.sizes) {
+          // a sorted load makes the BST a list, quadratic to build
+          if (std::strncmp(dict_name, "BST", 3) == 0 and dist == kSequential and n > 10000) {
+            continue;
+          }
+
+          for (int w = 0; w < 6; w++) {
+            std::ostringstream name;
+            name << dict_name << "/" << KeyMaker<K>::name() << "/" << distribution_name(dist) << "/"
+                 << workloads[w] << "/" << n;
+            if (name.str().find(options_.filter) == std::string::npos or
+                (w == 4 and !DictOps<Dict>::kIterable) or (w == 5 and !RangeOps<Dict>::kOrdered)) {
+              continue;
+            }
+
+            reset_peak_rss();
+            Runner<Dict, K> runner(dist, n, options_.min_ops);
+            Timer timer;
+            uint64_t ops = 0;
+            switch (w) {
+              case 0: ops = runner.insert(&timer); break;
+              case 1: ops = runner.lookup(&timer); break;
+              case 2: ops = runner.erase(&timer); break;
+              case 3: ops = runner.mixed(&timer); break;
+              case 4: ops = runner.iterate(&timer); break;
+              default: ops = runner.range(&timer); break;
+            }
+
+            Result result = {name.str(), ops, timer.ns(), timer.allocations(), peak_rss()};
+            report(result);
+            results_.push_back(result);
+          }
+        }
+      }
+    }
+
+    void write_json(std::ostream& os) const {
+      char date[64];
+      std::time_t now = std::time(nullptr);
+      std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+
+      os << "{\n  \"context\": {\n";
+      os << "    \"date\": \"" << date << "\",\n";
+      os << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+#ifdef NDEBUG
+      os << "    \"library_build_type\": \"release\",\n";
+#else
+      os << "    \"library_build_type\": \"debug\",\n";
+#endif
+      os << "    \"min_ops\": " << options_.min_ops << "\n";
+      os << "  },\n  \"benchmarks\": [\n";
+
+      for (size_t i = 0; i < results_.size(); i++) {
+        const Result& r = results_[i];
+        os << "    {\n";
+        os << "      \"name\": \"" << r.name << "\",\n";
+        os << "      \"run_type\": \"iteration\",\n";
+        os << "      \"iterations\": " << r.ops << ",\n";
+        os << "      \"real_time\": " << r.ns / r.ops << ",\n";
+        os << "      \"time_unit\": \"ns\",\n";
+        os << "      \"allocs_per_op\": " << static_cast<double>(r.allocations) / r.ops << ",\n";
+        os << "      \"peak_rss_bytes\": " << r.peak_rss << "\n";
+        os << "    }" << (i + 1 < results_.size() ? "," : "") << "\n";
+      }
+      os << "  ]\n}\n";
+    }
+
+  private:
+    static void report(const Result& r) {
+      std::fprintf(stderr, "%-50s %12.2f ns/op %8.3f allocs/op %10llu KiB peak\n", r.name.c_str(),
+                   r.ns / r.ops, static_cast<double>(r.allocations) / r.ops,
+                   static_cast<unsigned long long>(r.peak_rss / 1024));
+    }
+
+    Options options_;
+    std::vector<Result> results_;
+};
+
+template<typename K>
+void run_all(Suite* suite) {
+  suite->run<dicts::HashMap<K, int64_t>, K>("HashMap");
+  suite->run<dicts::CuckooHashMap<K, int64_t>, K>("CuckooHashMap");
+  suite->run<dicts::AVLDict<K, int64_t>, K>("AVLDict");
+  suite->run<dicts::PersistentAVLDict<K, int64_t>, K>("PersistentAVLDict");
+  suite->run<dicts::SplayDict<K, int64_t>, K>("SplayDict");
+  suite->run<dicts::BPlusTreeDict<K, int64_t>, K>("BPlusTreeDict");
+  suite->run<dicts::AVLDict<K, int64_t, dicts::PoolAllocator<K> >, K>("AVLDict+pool");
+  suite->run<dicts::SplayDict<K, int64_t, dicts::PoolAllocator<K> >, K>("SplayDict+pool");
+  suite->run<dicts::BPlusTreeDict<K, int64_t, dicts::PoolAllocator<K> >, K>("BPlusTreeDict+pool");
+  suite->run<dicts::BST<K, int64_t>, K>("BST");
+  suite->run<dicts::BST<K, int64_t, dicts::PoolAllocator<K> >, K>("BST+pool");
+  suite->run<std::map<K, int64_t>, K>("std::map");
+  suite->run<std::unordered_map<K, int64_t>, K>("std::unordered_map");
+}
+
+bool parse_args(int argc, char* argv[], Options* options) {
+  options->sizes = {1000, 10000, 100000, 1000000};
+  options->min_ops = 1000000;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    std::string value = arg.substr(arg.find('=') + 1);
+
+    if (arg.compare(0, 8, "--sizes=") == 0) {
+      options->sizes.clear();
+      std::istringstream sizes(value);
+      std::string size;
+      while (std::getline(sizes, size, ',')) {
+        options->sizes.push_back(static_cast<uint64_t>(std::atof(size.c_str())));
+      }
+    } else if (arg.compare(0, 9, "--filter=") == 0) {
+      options->filter = value;
+    } else if (arg.compare(0, 10, "--min-ops=") == 0) {
+      options->min_ops = static_cast<uint64_t>(std::atof(value.c_str()));
+    } else if (arg.compare(0, 7, "--json=") == 0) {
+      options->json_path = value;
+    } else {
+      return false;
+    }
+  }
+
+  return !options->sizes.empty() and options->sizes[0] > 0;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!parse_args(argc, argv, &options)) {
+    std::cerr << "usage: dict_bench [--sizes=1e3,1e4,...] [--filter=substring] "
+              << "[--min-ops=N] [--json=path]" << std::endl;
+    return 1;
+  }
+
+  Suite suite(options);
+  run_all<int64_t>(&suite);
+  run_all<std::string>(&suite);
+
+  if (options.json_path.empty()) {
+    suite.write_json(std::cout);
+  } else {
+    std::ofstream out(options.json_path.c_str());
+    suite.write_json(out);
+  }
+
+  return g_sink == 1 ? 1 : 0;
+}
@@ -1,13 +1,20 @@
 #ifndef BINARY_SEARCH_TREE_H_
 #define BINARY_SEARCH_TREE_H_
 
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
 #include <utility>  
 #include <iostream>  
 #include <stack>  
+#include <vector>
+
+#include "../pool_allocator/pool_allocator.hpp"
 
 namespace dicts {
 
-template<typename K, typename V> 
+template<typename K, typename V, typename A = std::allocator<std::pair<const K, V> > >
 class BST {
   private:
     struct Node; //Forward declaration
@@ -50,10 +57,25 @@ class BST {
     
     BST();
     
+    // nodes are allocated with alloc, e.g. a PoolAllocator
+    explicit BST(const A& alloc);
+    
     BST(const BST& bst);
     
+    // takes the nodes of bst, which is left empty
+    BST(BST&& bst);
+    
     ~BST();
     
+    // Builds a balanced tree out of the (key, value) pairs in [first, last),
+    // whose keys must be strictly increasing, in O(n). The nodes are
+    // allocated in key order, so that they end up next to each other.
+    template<typename ForwardIt>
+    static BST from_sorted(ForwardIt first, ForwardIt last, const A& alloc = A());
+    
+    template<typename Range>
+    static BST from_sorted(const Range& range, const A& alloc = A());
+    
     bool exists(const K& key) const;
     
     V& get(const K& key) const;
@@ -68,6 +90,21 @@ class BST {
     
     ConstIterator end();
     
+    // first entry whose key is not below key, or end()
+    ConstIterator lower_bound(const K& key);
+    
+    // first entry whose key is above key, or end()
+    ConstIterator upper_bound(const K& key);
+    
+    std::pair<ConstIterator, ConstIterator> equal_range(const K& key);
+    
+    // Calls fn(key, val) on the entries with lo <= key < hi in key order
+    // until fn returns false. One descent finds lo, then the nodes are
+    // streamed off a stack, so k entries cost O(h + k) node visits for the
+    // height h of the tree, which keys inserted in order make O(n).
+    template<typename F>
+    void for_each_in_range(const K& lo, const K& hi, F fn);
+    
   private: 
     struct Node {
       K key;
@@ -90,6 +127,10 @@ class BST {
     
     Node* findNode(Node* subtree, const K& key) const; 
     
+    Node* lowerNode(const K& key) const;
+    
+    Node* upperNode(const K& key) const;
+    
     void set(Node*& subtree, Node* parent, const K& key, const V& val);
     
     static Node* subtreeMin(Node* subtree);
@@ -100,19 +141,42 @@ class BST {
     
     void erase_node(Node* node);
     
+    typedef typename std::allocator_traits<A>::template rebind_alloc<Node> NodeAllocator;
+    typedef std::allocator_traits<NodeAllocator> NodeTraits;
+
+    Node* create_node(Node* parent, const K& key, const V& val);
+    
+    template<typename ForwardIt>
+    Node* buildSorted(ForwardIt& it, size_t n, Node* parent);
+
+    void destroy_node(Node* node);
+
     Node* root;
+
+    NodeAllocator node_alloc;
     
   friend class ConstIterator;
     
 };
 
-template<typename K, typename V> 
-BST<K, V>::BST() {
+template<typename K, typename V, typename A> 
+BST<K, V, A>::BST() {
     root = nullptr;
 }
 
-template<typename K, typename V> 
-BST<K, V>::~BST() {
+template<typename K, typename V, typename A> 
+BST<K, V, A>::BST(const A& alloc): node_alloc(alloc) {
+    root = nullptr;
+}
+
+template<typename K, typename V, typename A> 
+BST<K, V, A>::~BST() {
+  // nodes that need no destructor are left to an allocator that frees
+  // them in bulk, e.g. a PoolAllocator that no one else uses
+  if (std::is_trivially_destructible<Node>::value and internal::releases_in_bulk(node_alloc)) {
+    return;
+  }
+
   std::stack<Node*> nodes;
   nodes.push(root);
   
@@ -124,56 +188,164 @@ BST<K, V>::~BST() {
       nodes.push(current->left);
       nodes.push(current->right);
 
-      delete current;
+      destroy_node(current);
     }
     
   }
 }
 
-template<typename K, typename V> 
-BST<K, V>::BST(const BST& bst) {
+template<typename K, typename V, typename A> 
+BST<K, V, A>::BST(const BST& bst):
+                node_alloc(NodeTraits::select_on_container_copy_construction(bst.node_alloc)) {
+  root = nullptr;
   for (ConstIterator it = bst.begin(); it != bst.end(); it++) {
     set( (*it).first, (*it).second);
   }
 }
 
-template<typename K, typename V> 
-bool BST<K, V>::exists(const K& key) const {
+template<typename K, typename V, typename A> 
+BST<K, V, A>::BST(BST&& bst): node_alloc(bst.node_alloc) {
+  root = bst.root;
+  bst.root = nullptr;
+}
+
+template<typename K, typename V, typename A> 
+template<typename ForwardIt>
+BST<K, V, A> BST<K, V, A>::from_sorted(ForwardIt first, ForwardIt last, const A& alloc) {
+  size_t n = 0;
+  for (ForwardIt it = first, prev = first; it != last; prev = it++, n++) {
+    assert(n == 0 or (*prev).first < (*it).first);
+  }
+  
+  BST dict(alloc);
+  dict.root = dict.buildSorted(first, n, nullptr);
+  return dict;
+}
+
+template<typename K, typename V, typename A> 
+template<typename Range>
+BST<K, V, A> BST<K, V, A>::from_sorted(const Range& range, const A& alloc) {
+  return from_sorted(range.begin(), range.end(), alloc);
+}
+
+// Builds the n entries from it on in order: the lower half into the left
+// subtree, then the middle one, then the upper half. The halves differ by
+// one entry at most, and so do the heights of the subtrees.
+template<typename K, typename V, typename A> 
+template<typename ForwardIt>
+typename BST<K, V, A>::Node* BST<K, V, A>::buildSorted(ForwardIt& it, size_t n, Node* parent) {
+  if (n == 0) {
+    return nullptr;
+  }
+  
+  Node* left = buildSorted(it, n / 2, nullptr);
+  Node* node = create_node(parent, (*it).first, (*it).second);
+  ++it;
+  
+  node->left = left;
+  if (left != nullptr) {
+    left->parent = node;
+  }
+  node->right = buildSorted(it, n - n / 2 - 1, node);
+  return node;
+}
+
+template<typename K, typename V, typename A> 
+typename BST<K, V, A>::Node* BST<K, V, A>::create_node(Node* parent, const K& key, const V& val) {
+  Node* node = NodeTraits::allocate(node_alloc, 1);
+  NodeTraits::construct(node_alloc, node, parent, key, val);
+  return node;
+}
+
+template<typename K, typename V, typename A> 
+void BST<K, V, A>::destroy_node(Node* node) {
+  NodeTraits::destroy(node_alloc, node);
+  NodeTraits::deallocate(node_alloc, node, 1);
+}
+
+template<typename K, typename V, typename A> 
+bool BST<K, V, A>::exists(const K& key) const {
   return findNode(root, key) != nullptr;
 }
 
-template<typename K, typename V> 
-V& BST<K, V>::get(const K& key) const {
+template<typename K, typename V, typename A> 
+V& BST<K, V, A>::get(const K& key) const {
   return findNode(root, key)->val;
 }
 
-template<typename K, typename V> 
-void BST<K, V>::set(const K& key, const V& val) {
+template<typename K, typename V, typename A> 
+void BST<K, V, A>::set(const K& key, const V& val) {
   set(root, nullptr, key, val);
 }
 
-template<typename K, typename V> 
-void BST<K, V>::erase(const K& key){
+template<typename K, typename V, typename A> 
+void BST<K, V, A>::erase(const K& key){
   Node* node = findNode(root, key);
   
   erase_node(node);
 }
 
-template<typename K, typename V> 
-typename BST<K,V>::ConstIterator BST<K, V>::begin(){
+template<typename K, typename V, typename A> 
+typename BST<K, V, A>::ConstIterator BST<K, V, A>::begin(){
   ConstIterator it = ConstIterator(root);
   return it;
 }
 
-template<typename K, typename V> 
-typename BST<K,V>::ConstIterator BST<K, V>::end(){
+template<typename K, typename V, typename A> 
+typename BST<K, V, A>::ConstIterator BST<K, V, A>::end(){
   ConstIterator it = ConstIterator(nullptr, root);
   return it;
 }
 
+template<typename K, typename V, typename A> 
+typename BST<K, V, A>::ConstIterator BST<K, V, A>::lower_bound(const K& key){
+  Node* node = lowerNode(key);
+  return ConstIterator(node, node == nullptr ? root : node->left);
+}
+
+template<typename K, typename V, typename A> 
+typename BST<K, V, A>::ConstIterator BST<K, V, A>::upper_bound(const K& key){
+  Node* node = upperNode(key);
+  return ConstIterator(node, node == nullptr ? root : node->left);
+}
+
+template<typename K, typename V, typename A> 
+std::pair<typename BST<K, V, A>::ConstIterator, typename BST<K, V, A>::ConstIterator> BST<K, V, A>::equal_range(const K& key){
+  ConstIterator first = lower_bound(key);
+  return std::make_pair(first, upper_bound(key));
+}
 
-template<typename K, typename V> 
-typename BST<K, V>::Node* BST<K, V>::findNode(Node* subtree, const K& key) const{
+template<typename K, typename V, typename A> 
+template<typename F>
+void BST<K, V, A>::for_each_in_range(const K& lo, const K& hi, F fn){
+  // the nodes still to visit, one per level at most
+  std::vector<Node*> pending;
+  pending.reserve(64);
+  
+  for (Node* node = root; node != nullptr; ) {
+    if (node->key < lo) {
+      node = node->right;
+    } else {
+      pending.push_back(node);
+      node = node->left;
+    }
+  }
+  
+  while (!pending.empty()) {
+    Node* node = pending.back();
+    pending.pop_back();
+    if (!(node->key < hi) or !fn(node->key, node->val)) {
+      return;
+    }
+    for (Node* child = node->right; child != nullptr; child = child->left) {
+      pending.push_back(child);
+    }
+  }
+}
+
+
+template<typename K, typename V, typename A> 
+typename BST<K, V, A>::Node* BST<K, V, A>::findNode(Node* subtree, const K& key) const{
   if (subtree == nullptr){
     return nullptr;
   }
@@ -188,12 +360,42 @@ typename BST<K, V>::Node* BST<K, V>::findNode(Node* subtree, const K& key) const
   }  
 }
 
+template<typename K, typename V, typename A> 
+typename BST<K, V, A>::Node* BST<K, V, A>::lowerNode(const K& key) const{
+  Node* bound = nullptr;
+  Node* node = root;
+  while (node != nullptr) {
+    if (node->key < key) {
+      node = node->right;
+    } else {
+      bound = node;
+      node = node->left;
+    }
+  }
+  return bound;
+}
+
+template<typename K, typename V, typename A> 
+typename BST<K, V, A>::Node* BST<K, V, A>::upperNode(const K& key) const{
+  Node* bound = nullptr;
+  Node* node = root;
+  while (node != nullptr) {
+    if (key < node->key) {
+      bound = node;
+      node = node->left;
+    } else {
+      node = node->right;
+    }
+  }
+  return bound;
+}
+
 
-template<typename K, typename V> 
-void BST<K, V>::set(Node*& subtree, Node* parent, const K& key, const V& val){
+template<typename K, typename V, typename A> 
+void BST<K, V, A>::set(Node*& subtree, Node* parent, const K& key, const V& val){
   if (subtree == nullptr) {
     // by using the reference to pointer, we update parent's pointer 
-    subtree = new Node(parent, key, val);
+    subtree = create_node(parent, key, val);
   }
   else if (subtree->key == key) {
     subtree->val = val;
@@ -206,8 +408,8 @@ void BST<K, V>::set(Node*& subtree, Node* parent, const K& key, const V& val){
   }
 }
 
-template<typename K, typename V> 
-typename BST<K,V>::Node* BST<K, V>::subtreeMaxKey(Node* subtree, Node* parent){
+template<typename K, typename V, typename A> 
+typename BST<K, V, A>::Node* BST<K, V, A>::subtreeMaxKey(Node* subtree, Node* parent){
   if (subtree == nullptr){
     return parent;
   }
@@ -217,13 +419,13 @@ typename BST<K,V>::Node* BST<K, V>::subtreeMaxKey(Node* subtree, Node* parent){
 }
 
 
-template<typename K, typename V> 
-typename BST<K,V>::Node* BST<K, V>::subtreeMin(Node* subtree){
+template<typename K, typename V, typename A> 
+typename BST<K, V, A>::Node* BST<K, V, A>::subtreeMin(Node* subtree){
   return subtreeMinKey(subtree->left, subtree);
 }
 
-template<typename K, typename V> 
-typename BST<K,V>::Node* BST<K, V>::subtreeMinKey(Node* subtree, Node* parent){
+template<typename K, typename V, typename A> 
+typename BST<K, V, A>::Node* BST<K, V, A>::subtreeMinKey(Node* subtree, Node* parent){
   if (subtree == nullptr){
     return parent;
   }
@@ -232,8 +434,8 @@ typename BST<K,V>::Node* BST<K, V>::subtreeMinKey(Node* subtree, Node* parent){
   }
 }
 
-template<typename K, typename V> 
-void BST<K, V>::erase_node(Node* node){
+template<typename K, typename V, typename A> 
+void BST<K, V, A>::erase_node(Node* node){
 
   if (node->left == nullptr and node->right == nullptr){
     if (node != root){
@@ -245,7 +447,7 @@ void BST<K, V>::erase_node(Node* node){
       }
     }
     
-    delete node;
+    destroy_node(node);
   }
   else if (node->left != nullptr and node->right != nullptr){ 
     // Going always right in the left subtree is the predecessor
@@ -282,39 +484,40 @@ void BST<K, V>::erase_node(Node* node){
       child->parent = nullptr;
     }
     
-    delete node;
+    destroy_node(node);
   }
   
 }
 
-template<typename K, typename V> 
-const std::pair<K&, V&> BST<K, V>::ConstIterator::operator*() const {
+template<typename K, typename V, typename A> 
+const std::pair<K&, V&> BST<K, V, A>::ConstIterator::operator*() const {
   std::pair<K&, V&> res {current->key, current->val};
   return res;
 }
 
 
-template<typename K, typename V> 
-typename BST<K,V>::ConstIterator& BST<K, V>::ConstIterator::operator=(const ConstIterator& it) {
+template<typename K, typename V, typename A> 
+typename BST<K, V, A>::ConstIterator& BST<K, V, A>::ConstIterator::operator=(const ConstIterator& it) {
   current = it.current;
   prev = it.prev;
   
   return *this;
 }
 
-template<typename K, typename V> 
-bool BST<K, V>::ConstIterator::operator==(const ConstIterator& it) const {
-  return (current == it.current and prev == it.prev);
+template<typename K, typename V, typename A> 
+bool BST<K, V, A>::ConstIterator::operator==(const ConstIterator& it) const {
+  // prev depends on the way current was reached
+  return current == it.current;
 }
 
-template<typename K, typename V> 
-bool BST<K, V>::ConstIterator::operator!=(const ConstIterator& it) const {
+template<typename K, typename V, typename A> 
+bool BST<K, V, A>::ConstIterator::operator!=(const ConstIterator& it) const {
   return !(*this == it);
 }
 
 
-template<typename K, typename V> 
-typename BST<K,V>::ConstIterator& BST<K, V>::ConstIterator::operator++(int) {
+template<typename K, typename V, typename A> 
+typename BST<K, V, A>::ConstIterator& BST<K, V, A>::ConstIterator::operator++(int) {
   if (prev != nullptr and prev->left == current) {
     if (current->right != nullptr){
       current = subtreeMin(current->right);
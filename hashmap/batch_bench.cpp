@@ -0,0 +1,55 @@
+#include "hash_map.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Compares a loop of get() against find_batch() on a table that does not
+// fit in the last level cache.
+//
+// usage: batch_bench [entries] [batch size]
+
+int main(int argc, char* argv[]) {
+  int n_entries = argc > 1 ? std::atoi(argv[1]) : 8000000;
+  int batch = argc > 2 ? std::atoi(argv[2]) : 256;
+  const int n_lookups = 4000000;
+
+  dicts::HashMap<int64_t, int64_t> hm;
+  for (int i = 0; i < n_entries; i++) {
+    hm.set(i, i);
+  }
+
+  std::mt19937_64 rng(42);
+  std::vector<int64_t> keys(n_lookups);
+  for (auto& key : keys) {
+    key = rng() % n_entries;
+  }
+
+  int64_t checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < n_lookups; i++) {
+    checksum += hm.get(keys[i]);
+  }
+  double get_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  std::vector<int64_t*> results(batch);
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i + batch <= n_lookups; i += batch) {
+    hm.find_batch(&keys[i], batch, results.data());
+    for (int j = 0; j < batch; j++) {
+      checksum -= *results[j];
+    }
+  }
+  double batch_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  int batched = n_lookups / batch * batch;
+  std::cout << "entries " << n_entries << ", batch " << batch << std::endl;
+  std::cout << "get loop:   " << get_ns / n_lookups << " ns/lookup" << std::endl;
+  std::cout << "find_batch: " << batch_ns / batched << " ns/lookup" << std::endl;
+  std::cout << "speedup:    " << (get_ns / n_lookups) / (batch_ns / batched) << "x" << std::endl;
+
+  // keeps the lookups from being optimised away
+  return checksum == 1 ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+#include "concurrent_hash_map.hpp"
+#include "read_mostly_hash_map.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Throughput of ConcurrentHashMap and ReadMostlyHashMap against a HashMap
+// behind one global mutex, for 1 to 64 threads and several read/write mixes.
+//
+// usage: concurrent_bench [keys] [ops per thread]
+
+class GlobalLockMap {
+  public:
+    bool find(int64_t key, int64_t* val) {
+      std::lock_guard<std::mutex> guard(mutex_);
+      int64_t* found = map_.find(key);
+      if (found != nullptr) {
+        *val = *found;
+      }
+      return found != nullptr;
+    }
+
+    void set(int64_t key, int64_t val) {
+      std::lock_guard<std::mutex> guard(mutex_);
+      map_.set(key, val);
+    }
+
+  private:
+    std::mutex mutex_;
+    dicts::HashMap<int64_t, int64_t> map_;
+};
+
+template<typename M>
+double run(M& map, int n_threads, int read_percent, int n_keys, int ops_per_thread) {
+  std::vector<std::thread> threads;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int t = 0; t < n_threads; t++) {
+    threads.push_back(std::thread([&map, t, read_percent, n_keys, ops_per_thread]() {
+      std::mt19937_64 rng(t);
+      int64_t val = 0;
+      for (int i = 0; i < ops_per_thread; i++) {
+        int64_t key = rng() % n_keys;
+        if (static_cast<int>(rng() % 100) < read_percent) {
+          map.find(key, &val);
+        } else {
+          map.set(key, i);
+        }
+      }
+    }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  return n_threads * static_cast<double>(ops_per_thread) / seconds / 1e6;
+}
+
+int main(int argc, char* argv[]) {
+  int n_keys = argc > 1 ? std::atoi(argv[1]) : 1000000;
+  int ops_per_thread = argc > 2 ? std::atoi(argv[2]) : 200000;
+
+  const int read_mixes[] = {100, 99, 95, 50};
+
+  std::cout << "threads\tread%\tsharded Mops/s\tread mostly Mops/s\tglobal lock Mops/s" << std::endl;
+  for (int read_percent : read_mixes) {
+    for (int n_threads = 1; n_threads <= 64; n_threads *= 2) {
+      dicts::ConcurrentHashMap<int64_t, int64_t> sharded;
+      dicts::ReadMostlyHashMap<int64_t, int64_t> read_mostly;
+      GlobalLockMap global;
+      for (int64_t i = 0; i < n_keys; i++) {
+        sharded.set(i, i);
+        read_mostly.set(i, i);
+        global.set(i, i);
+      }
+
+      double sharded_mops = run(sharded, n_threads, read_percent, n_keys, ops_per_thread);
+      double read_mostly_mops = run(read_mostly, n_threads, read_percent, n_keys, ops_per_thread);
+      double global_mops = run(global, n_threads, read_percent, n_keys, ops_per_thread);
+
+      std::cout << n_threads << "\t" << read_percent << "\t"
+                << sharded_mops << "\t\t" << read_mostly_mops << "\t\t\t" << global_mops << std::endl;
+    }
+  }
+}
@@ -0,0 +1,279 @@
+#ifndef HASHMAP_CONCURRENT_HASH_MAP_H_
+#define HASHMAP_CONCURRENT_HASH_MAP_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <thread>
+
+#include "hash_map.hpp"
+
+namespace dicts {
+
+namespace internal {
+
+inline void cpu_relax() {
+#if defined(__SSE2__)
+  _mm_pause();
+#else
+  std::this_thread::yield();
+#endif
+}
+
+// Reader-writer spin lock. Readers share it, a writer waiting for the
+// readers to leave keeps new readers out so it is not starved.
+class SharedSpinLock {
+  public:
+    SharedSpinLock(): state_(0) {}
+
+    void lock() {
+      for (int spins = 0; ; spins++) {
+        int s = state_.load(std::memory_order_relaxed);
+
+        if ((s & ~kWriterWaiting) == 0 and
+            state_.compare_exchange_weak(s, kWriter, std::memory_order_acquire)) {
+          return;
+        }
+
+        if ((s & kWriterWaiting) == 0) {
+          state_.fetch_or(kWriterWaiting, std::memory_order_relaxed);
+        }
+        backoff(spins);
+      }
+    }
+
+    void unlock() {
+      state_.fetch_and(~kWriter, std::memory_order_release);
+    }
+
+    void lock_shared() {
+      for (int spins = 0; ; spins++) {
+        int s = state_.load(std::memory_order_relaxed);
+
+        if ((s & (kWriter | kWriterWaiting)) == 0 and
+            state_.compare_exchange_weak(s, s + kReader, std::memory_order_acquire)) {
+          return;
+        }
+        backoff(spins);
+      }
+    }
+
+    void unlock_shared() {
+      state_.fetch_sub(kReader, std::memory_order_release);
+    }
+
+  private:
+    static void backoff(int spins) {
+      if (spins < 64) {
+        cpu_relax();
+      } else {
+        std::this_thread::yield();
+      }
+    }
+
+    static const int kWriter = 1;
+    static const int kWriterWaiting = 2;
+    static const int kReader = 4;
+
+    std::atomic<int> state_;
+};
+
+}
+
+// Thread safe HashMap made of independent shards, each one a HashMap with
+// its own reader-writer lock. The shard of a key is picked with the high
+// bits of its mixed hash, which the shard tables do not use for probing,
+// and the shard only gets the user hash so the key is hashed once. A shard
+// that grows only blocks the keys of that shard.
+template<typename K, typename V, typename H = std::hash<K>, typename E = std::equal_to<K> >
+class ConcurrentHashMap {
+  public:
+    // n_shards is rounded up to a power of two
+    explicit ConcurrentHashMap(int n_shards = kDefaultShards);
+
+    ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+
+    ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
+
+    ~ConcurrentHashMap();
+
+    // Values are copied out, references would outlive the shard lock.
+    V get(const K& key) const;
+
+    bool find(const K& key, V* val) const;
+
+    bool exists(const K& key) const;
+
+    void set(const K& key, const V& val);
+
+    void erase(const K& key);
+
+    // Grows the shards incrementally, which bounds how long a writer holds
+    // the lock of its shard, see HashMap::set_incremental_resize.
+    void set_incremental_resize(bool incremental);
+
+    int shard_count() const;
+
+    // Statistics of all the shards added up, the load factor is their mean.
+    // See HashMap::stats.
+    HashMapStats stats() const;
+
+  private:
+    // each shard starts a cache line, so the lock of a shard is not on a
+    // line read by the previous shard
+    struct alignas(64) Shard {
+        mutable internal::SharedSpinLock lock;
+        HashMap<K, V, H, E> map;
+    };
+
+    Shard& shard_for(size_t hash) const;
+
+    static const int kDefaultShards = 64;
+
+    const H hash_fn_;
+
+    int shard_bits_;
+
+    std::unique_ptr<char[]> storage_;
+
+    // storage_ aligned to a cache line
+    Shard* shards_;
+};
+
+
+template<typename K, typename V, typename H, typename E>
+ConcurrentHashMap<K, V, H, E>::ConcurrentHashMap(int n_shards):
+                hash_fn_(H())
+{
+  assert(n_shards > 0);
+
+  shard_bits_ = 0;
+  while ((1 << shard_bits_) < n_shards) {
+    shard_bits_++;
+  }
+
+  // new[] does not align beyond max_align_t in C++11, so the array is
+  // aligned by hand
+  int n = 1 << shard_bits_;
+  storage_.reset(new char[n * sizeof(Shard) + alignof(Shard)]);
+
+  void* start = storage_.get();
+  size_t space = n * sizeof(Shard) + alignof(Shard);
+  shards_ = static_cast<Shard*>(std::align(alignof(Shard), n * sizeof(Shard), start, space));
+  for (int i = 0; i < n; i++) {
+    new (&shards_[i]) Shard();
+  }
+}
+
+template<typename K, typename V, typename H, typename E>
+ConcurrentHashMap<K, V, H, E>::~ConcurrentHashMap() {
+  for (int i = 0; i < (1 << shard_bits_); i++) {
+    shards_[i].~Shard();
+  }
+}
+
+template<typename K, typename V, typename H, typename E>
+typename ConcurrentHashMap<K, V, H, E>::Shard& ConcurrentHashMap<K, V, H, E>::shard_for(size_t hash) const {
+  if (shard_bits_ == 0) {
+    return shards_[0];
+  }
+
+  uint64_t mixed = internal::mix_hash(hash);
+  return shards_[static_cast<int>(mixed >> (64 - shard_bits_))];
+}
+
+template<typename K, typename V, typename H, typename E>
+V ConcurrentHashMap<K, V, H, E>::get(const K& key) const {
+  V val;
+  bool found = find(key, &val);
+  assert(found);
+  (void) found;
+  return val;
+}
+
+template<typename K, typename V, typename H, typename E>
+bool ConcurrentHashMap<K, V, H, E>::find(const K& key, V* val) const {
+  size_t hash = hash_fn_(key);
+  Shard& shard = shard_for(hash);
+
+  shard.lock.lock_shared();
+  V* found = shard.map.find_with_hash(key, hash);
+  if (found != nullptr) {
+    *val = *found;
+  }
+  shard.lock.unlock_shared();
+
+  return found != nullptr;
+}
+
+template<typename K, typename V, typename H, typename E>
+bool ConcurrentHashMap<K, V, H, E>::exists(const K& key) const {
+  size_t hash = hash_fn_(key);
+  Shard& shard = shard_for(hash);
+
+  shard.lock.lock_shared();
+  bool found = shard.map.find_with_hash(key, hash) != nullptr;
+  shard.lock.unlock_shared();
+
+  return found;
+}
+
+template<typename K, typename V, typename H, typename E>
+void ConcurrentHashMap<K, V, H, E>::set(const K& key, const V& val) {
+  size_t hash = hash_fn_(key);
+  Shard& shard = shard_for(hash);
+
+  shard.lock.lock();
+  shard.map.set_with_hash(key, val, hash);
+  shard.lock.unlock();
+}
+
+template<typename K, typename V, typename H, typename E>
+void ConcurrentHashMap<K, V, H, E>::erase(const K& key) {
+  size_t hash = hash_fn_(key);
+  Shard& shard = shard_for(hash);
+
+  shard.lock.lock();
+  shard.map.erase_with_hash(key, hash);
+  shard.lock.unlock();
+}
+
+template<typename K, typename V, typename H, typename E>
+void ConcurrentHashMap<K, V, H, E>::set_incremental_resize(bool incremental) {
+  for (int i = 0; i < shard_count(); i++) {
+    shards_[i].lock.lock();
+    shards_[i].map.set_incremental_resize(incremental);
+    shards_[i].lock.unlock();
+  }
+}
+
+template<typename K, typename V, typename H, typename E>
+int ConcurrentHashMap<K, V, H, E>::shard_count() const {
+  return 1 << shard_bits_;
+}
+
+template<typename K, typename V, typename H, typename E>
+HashMapStats ConcurrentHashMap<K, V, H, E>::stats() const {
+  HashMapStats total;
+  double load = 0;
+
+  for (int i = 0; i < shard_count(); i++) {
+    shards_[i].lock.lock_shared();
+    HashMapStats shard_stats = shards_[i].map.stats();
+    shards_[i].lock.unlock_shared();
+
+    total.merge(shard_stats);
+    load += shard_stats.load_factor;
+  }
+
+  total.load_factor = load / shard_count();
+  return total;
+}
+
+}
+
+#endif
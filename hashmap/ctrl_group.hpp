@@ -0,0 +1,231 @@
+#ifndef HASHMAP_CTRL_GROUP_H_
+#define HASHMAP_CTRL_GROUP_H_
+
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace dicts {
+namespace internal {
+
+// Every slot of the table has a control byte. A full slot stores the low
+// 7 bits of its hash (the fragment), so the sign bit is only set for the
+// special states below.
+typedef signed char ctrl_t;
+
+const ctrl_t kEmpty = -128;
+const ctrl_t kDeleted = -2;
+
+inline bool is_full(ctrl_t c) {
+  return c >= 0;
+}
+
+inline int count_trailing_zeros(uint32_t x) {
+#if defined(__GNUC__)
+  return __builtin_ctz(x);
+#else
+  int n = 0;
+  while ((x & 1u) == 0) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+// Hint to bring the cache line of ptr in before it is read.
+inline void prefetch(const void* ptr) {
+#if defined(__GNUC__)
+  __builtin_prefetch(ptr);
+#elif defined(__SSE2__)
+  _mm_prefetch(static_cast<const char*>(ptr), _MM_HINT_T0);
+#else
+  (void) ptr;
+#endif
+}
+
+// Set of matching positions inside a group, one bit per slot.
+class BitMask {
+  public:
+    explicit BitMask(uint32_t mask): mask_(mask) {}
+
+    bool any() const { return mask_ != 0; }
+
+    int lowest() const { return count_trailing_zeros(mask_); }
+
+    void clear_lowest() { mask_ &= mask_ - 1; }
+
+  private:
+    uint32_t mask_;
+};
+
+// A Group is a window of kWidth consecutive control bytes that is compared
+// against a fragment in one go, using AVX2 or SSE2 when the compiler
+// targets them and a plain loop otherwise.
+//
+// For Robin Hood tables, where a control byte holds a distance, a group
+// loaded at the home slot of a key also gives the slots i whose distance is
+// i (match_distance), the only ones that can hold the key, and those whose
+// distance is below i or that are empty (match_closer), where the probe
+// ends.
+#if defined(__AVX2__)
+
+struct Group {
+    static const int kWidth = 32;
+
+    explicit Group(const ctrl_t* pos) {
+      ctrl = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos));
+    }
+
+    BitMask match(ctrl_t h2) const {
+      __m256i eq = _mm256_cmpeq_epi8(_mm256_set1_epi8(h2), ctrl);
+      return BitMask(static_cast<uint32_t>(_mm256_movemask_epi8(eq)));
+    }
+
+    BitMask match_empty() const {
+      return match(kEmpty);
+    }
+
+    BitMask match_empty_or_deleted() const {
+      __m256i special = _mm256_cmpgt_epi8(_mm256_set1_epi8(-1), ctrl);
+      return BitMask(static_cast<uint32_t>(_mm256_movemask_epi8(special)));
+    }
+
+    BitMask match_full() const {
+      return BitMask(~static_cast<uint32_t>(_mm256_movemask_epi8(ctrl)));
+    }
+
+    BitMask match_distance() const {
+      __m256i eq = _mm256_cmpeq_epi8(ramp(), ctrl);
+      return BitMask(static_cast<uint32_t>(_mm256_movemask_epi8(eq)));
+    }
+
+    BitMask match_closer() const {
+      __m256i lt = _mm256_cmpgt_epi8(ramp(), ctrl);
+      return BitMask(static_cast<uint32_t>(_mm256_movemask_epi8(lt)));
+    }
+
+    static __m256i ramp() {
+      return _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                              16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+    }
+
+    __m256i ctrl;
+};
+
+#elif defined(__SSE2__)
+
+struct Group {
+    static const int kWidth = 16;
+
+    explicit Group(const ctrl_t* pos) {
+      ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+    }
+
+    BitMask match(ctrl_t h2) const {
+      __m128i eq = _mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl);
+      return BitMask(static_cast<uint32_t>(_mm_movemask_epi8(eq)));
+    }
+
+    BitMask match_empty() const {
+      return match(kEmpty);
+    }
+
+    BitMask match_empty_or_deleted() const {
+      __m128i special = _mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl);
+      return BitMask(static_cast<uint32_t>(_mm_movemask_epi8(special)));
+    }
+
+    BitMask match_full() const {
+      return BitMask(~static_cast<uint32_t>(_mm_movemask_epi8(ctrl)) & 0xFFFFu);
+    }
+
+    BitMask match_distance() const {
+      __m128i eq = _mm_cmpeq_epi8(ramp(), ctrl);
+      return BitMask(static_cast<uint32_t>(_mm_movemask_epi8(eq)));
+    }
+
+    BitMask match_closer() const {
+      __m128i lt = _mm_cmpgt_epi8(ramp(), ctrl);
+      return BitMask(static_cast<uint32_t>(_mm_movemask_epi8(lt)));
+    }
+
+    static __m128i ramp() {
+      return _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    }
+
+    __m128i ctrl;
+};
+
+#else
+
+struct Group {
+    static const int kWidth = 16;
+
+    explicit Group(const ctrl_t* pos): ctrl(pos) {}
+
+    BitMask match(ctrl_t h2) const {
+      uint32_t mask = 0;
+      for (int i = 0; i < kWidth; i++) {
+        if (ctrl[i] == h2) {
+          mask |= 1u << i;
+        }
+      }
+      return BitMask(mask);
+    }
+
+    BitMask match_empty() const {
+      return match(kEmpty);
+    }
+
+    BitMask match_empty_or_deleted() const {
+      uint32_t mask = 0;
+      for (int i = 0; i < kWidth; i++) {
+        if (ctrl[i] < -1) {
+          mask |= 1u << i;
+        }
+      }
+      return BitMask(mask);
+    }
+
+    BitMask match_full() const {
+      uint32_t mask = 0;
+      for (int i = 0; i < kWidth; i++) {
+        if (is_full(ctrl[i])) {
+          mask |= 1u << i;
+        }
+      }
+      return BitMask(mask);
+    }
+
+    BitMask match_distance() const {
+      uint32_t mask = 0;
+      for (int i = 0; i < kWidth; i++) {
+        if (ctrl[i] == i) {
+          mask |= 1u << i;
+        }
+      }
+      return BitMask(mask);
+    }
+
+    BitMask match_closer() const {
+      uint32_t mask = 0;
+      for (int i = 0; i < kWidth; i++) {
+        if (ctrl[i] < i) {
+          mask |= 1u << i;
+        }
+      }
+      return BitMask(mask);
+    }
+
+    const ctrl_t* ctrl;
+};
+
+#endif
+
+}
+}
+
+#endif
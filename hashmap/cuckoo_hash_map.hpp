@@ -0,0 +1,504 @@
+#ifndef HASHMAP_CUCKOO_HASH_MAP_H_
+#define HASHMAP_CUCKOO_HASH_MAP_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ctrl_group.hpp"
+#include "hash_mix.hpp"
+
+namespace dicts {
+namespace internal {
+
+// Most slots of the given size and alignment, up to n, that fit in a cache
+// line after one tag byte each.
+constexpr int cuckoo_bucket_slots(size_t size, size_t align, int n) {
+  return n == 0 or (n + align - 1) / align * align + n * size <= 64 ? n : cuckoo_bucket_slots(size, align, n - 1);
+}
+
+}
+
+// Bucketized cuckoo hash map for lookups with a bounded cost. Every key
+// lives in one of two buckets, so a lookup checks at most two buckets,
+// whatever the load and however bad the clustering, and a miss costs the
+// same as a hit in the second bucket.
+//
+// A bucket is one cache line holding kSlotsPerBucket slots, 3 to 7, next
+// to one tag byte per slot. Slots that fit 3 or more to a line, e.g. an
+// int key and an int value (7 slots) or an int64_t key and value (3), are
+// stored in the bucket and a lookup touches at most two lines.
+// Larger ones, e.g. with a std::string key, live on the heap with a pointer
+// in the bucket, 7 to a bucket: a lookup reads two bucket lines and then
+// only the entries whose tag matches, usually just the one it looks for.
+//
+// The second bucket is derived from the first one and the 8 bit tag of the
+// key (partial-key cuckoo hashing), so a key displaced by an insert is moved
+// to its other bucket without hashing it again. An insert that finds both
+// buckets full displaces keys along a random walk, and the table doubles
+// when the walk gets too long.
+template<typename K, typename V, typename H = std::hash<K>, typename E = std::equal_to<K> >
+class CuckooHashMap {
+  private:
+    struct Slot {
+        K key;
+        V val;
+
+        // the value is built from args, value initialised when there are none
+        template<typename KK, typename... Args>
+        Slot(KK&& k, Args&&... args): key(std::forward<KK>(k)), val(std::forward<Args>(args)...) {}
+    };
+
+  public:
+    // whether the slots are stored in the buckets rather than on the heap
+    static const bool kInlineSlots = internal::cuckoo_bucket_slots(sizeof(Slot), alignof(Slot), 7) >= 3;
+
+    static const int kSlotsPerBucket =
+        kInlineSlots ? internal::cuckoo_bucket_slots(sizeof(Slot), alignof(Slot), 7) : 7;
+
+    CuckooHashMap();
+
+    CuckooHashMap(const CuckooHashMap&) = delete;
+
+    CuckooHashMap& operator=(const CuckooHashMap&) = delete;
+
+    ~CuckooHashMap();
+
+    int size() const;
+
+    V& get(const K& key) const;
+
+    // Returns a pointer to the value of key, or nullptr when it is absent.
+    V* find(const K& key) const;
+
+    void set(const K& key, const V& val);
+
+    void erase(const K& key);
+
+    V& operator[](const K& key);
+
+    V& operator[](const K& key) const;
+
+  private:
+    typedef typename std::conditional<kInlineSlots, typename std::aligned_storage<sizeof(Slot), alignof(Slot)>::type,
+                                      Slot*>::type SlotStorage;
+
+    typedef std::integral_constant<bool, kInlineSlots> InlineSlots;
+
+    // tags[i] is 0 when slot i is empty
+    struct alignas(64) Bucket {
+        uint8_t tags[kSlotsPerBucket];
+        SlotStorage slots[kSlotsPerBucket];
+    };
+
+    static_assert(sizeof(Bucket) == 64, "a bucket is one cache line");
+
+    size_t hash_of(const K& key) const;
+
+    // tag of a hash, never 0
+    static uint8_t tag_of(size_t hash);
+
+    size_t first_bucket(size_t hash) const;
+
+    // the other bucket of a key with the given tag that is in bucket b,
+    // alt_bucket(alt_bucket(b, tag), tag) == b
+    size_t alt_bucket(size_t b, uint8_t tag) const;
+
+    Slot& slot(size_t b, int i) const;
+
+    // builds slot i of bucket b out of item, the slot must be free
+    void construct_slot(size_t b, int i, Slot&& item);
+
+    void destroy_slot(size_t b, int i);
+
+    static Slot& slot_at(SlotStorage& storage, std::true_type);
+
+    static Slot& slot_at(SlotStorage& storage, std::false_type);
+
+    Slot* find_slot(const K& key) const;
+
+    template<typename... Args>
+    Slot* insert_new(const K& key, Args&&... args);
+
+    // Moves item into one of the two buckets of its tag, first_bucket of
+    // its hash being b. Keys in the way are displaced to their other bucket.
+    // Returns the slot where the last moved key landed, which is item when
+    // nothing was displaced. On failure item holds one of the displaced keys
+    // and *tag its tag, and nullptr is returned.
+    Slot* place(Slot& item, uint8_t* tag, size_t b);
+
+    static int free_index(const Bucket& bucket);
+
+    // moves every key out of the table into items
+    void drain(std::vector<Slot>* items);
+
+    // rebuilds the table with at least n_buckets buckets out of items,
+    // doubling until a table where they all fit is found
+    void rebuild(std::vector<Slot>* items, int n_buckets);
+
+    void init_buckets(int n_buckets);
+
+    uint32_t next_random();
+
+    static const int kInitBuckets = 16;
+
+    // displacements tried by an insert before the table grows
+    static const int kMaxKicks = 256;
+
+    // inserts grow the table when it is this full, a random walk rarely
+    // succeeds beyond it with 4 or more slots per bucket, or beyond 0.9
+    // with 3
+    const double kLoadFactorBound = kSlotsPerBucket >= 4 ? 0.95 : 0.9;
+
+    const H hash_fn_;
+
+    const E eq_fn_;
+
+    std::unique_ptr<char[]> storage_;
+
+    // storage_ aligned to a cache line
+    Bucket* buckets_;
+
+    int n_buckets_;
+
+    int size_;
+
+    // state of the xorshift picking the keys to displace
+    uint32_t random_;
+};
+
+
+template<typename K, typename V, typename H, typename E>
+const bool CuckooHashMap<K, V, H, E>::kInlineSlots;
+
+template<typename K, typename V, typename H, typename E>
+const int CuckooHashMap<K, V, H, E>::kSlotsPerBucket;
+
+template<typename K, typename V, typename H, typename E>
+CuckooHashMap<K, V, H, E>::CuckooHashMap():
+                hash_fn_(H()),
+                eq_fn_(E()),
+                buckets_(nullptr),
+                n_buckets_(0),
+                size_(0),
+                random_(0x9e3779b9)
+{
+  init_buckets(kInitBuckets);
+}
+
+template<typename K, typename V, typename H, typename E>
+CuckooHashMap<K, V, H, E>::~CuckooHashMap() {
+  for (int b = 0; b < n_buckets_; b++) {
+    for (int i = 0; i < kSlotsPerBucket; i++) {
+      if (buckets_[b].tags[i] != 0) {
+        destroy_slot(b, i);
+      }
+    }
+  }
+}
+
+template<typename K, typename V, typename H, typename E>
+int CuckooHashMap<K, V, H, E>::size() const {
+  return size_;
+}
+
+template<typename K, typename V, typename H, typename E>
+size_t CuckooHashMap<K, V, H, E>::hash_of(const K& key) const {
+  return static_cast<size_t>(internal::mix_hash(hash_fn_(key)));
+}
+
+template<typename K, typename V, typename H, typename E>
+uint8_t CuckooHashMap<K, V, H, E>::tag_of(size_t hash) {
+  // the top byte, the low bits pick the first bucket
+  uint8_t tag = static_cast<uint8_t>(static_cast<uint64_t>(hash) >> 56);
+  return tag != 0 ? tag : 1;
+}
+
+template<typename K, typename V, typename H, typename E>
+size_t CuckooHashMap<K, V, H, E>::first_bucket(size_t hash) const {
+  return hash & static_cast<size_t>(n_buckets_ - 1);
+}
+
+template<typename K, typename V, typename H, typename E>
+size_t CuckooHashMap<K, V, H, E>::alt_bucket(size_t b, uint8_t tag) const {
+  // the tag is spread with an odd multiplier so that close tags do not
+  // pick close buckets, the xor makes the mapping its own inverse. The low
+  // bit is set so that the two buckets always differ, whatever the tag and
+  // the table size.
+  size_t spread = (static_cast<size_t>(tag) * 0x5bd1e995u) | 1;
+  return (b ^ spread) & static_cast<size_t>(n_buckets_ - 1);
+}
+
+template<typename K, typename V, typename H, typename E>
+typename CuckooHashMap<K, V, H, E>::Slot& CuckooHashMap<K, V, H, E>::slot(size_t b, int i) const {
+  return slot_at(buckets_[b].slots[i], InlineSlots());
+}
+
+template<typename K, typename V, typename H, typename E>
+typename CuckooHashMap<K, V, H, E>::Slot& CuckooHashMap<K, V, H, E>::slot_at(SlotStorage& storage, std::true_type) {
+  return *reinterpret_cast<Slot*>(&storage);
+}
+
+template<typename K, typename V, typename H, typename E>
+typename CuckooHashMap<K, V, H, E>::Slot& CuckooHashMap<K, V, H, E>::slot_at(SlotStorage& storage, std::false_type) {
+  return **reinterpret_cast<Slot**>(&storage);
+}
+
+template<typename K, typename V, typename H, typename E>
+void CuckooHashMap<K, V, H, E>::construct_slot(size_t b, int i, Slot&& item) {
+  SlotStorage* storage = &buckets_[b].slots[i];
+  if (kInlineSlots) {
+    new (storage) Slot(std::move(item));
+  } else {
+    *reinterpret_cast<Slot**>(storage) = new Slot(std::move(item));
+  }
+}
+
+template<typename K, typename V, typename H, typename E>
+void CuckooHashMap<K, V, H, E>::destroy_slot(size_t b, int i) {
+  if (kInlineSlots) {
+    slot(b, i).~Slot();
+  } else {
+    delete &slot(b, i);
+  }
+}
+
+template<typename K, typename V, typename H, typename E>
+typename CuckooHashMap<K, V, H, E>::Slot* CuckooHashMap<K, V, H, E>::find_slot(const K& key) const {
+  size_t hash = hash_of(key);
+  uint8_t tag = tag_of(hash);
+  size_t b1 = first_bucket(hash);
+  size_t b2 = alt_bucket(b1, tag);
+
+  // the second line is on its way while the first one is checked
+  internal::prefetch(&buckets_[b2]);
+
+  for (int i = 0; i < kSlotsPerBucket; i++) {
+    if (buckets_[b1].tags[i] == tag and eq_fn_(slot(b1, i).key, key)) {
+      return &slot(b1, i);
+    }
+  }
+  for (int i = 0; i < kSlotsPerBucket; i++) {
+    if (buckets_[b2].tags[i] == tag and eq_fn_(slot(b2, i).key, key)) {
+      return &slot(b2, i);
+    }
+  }
+
+  return nullptr;
+}
+
+template<typename K, typename V, typename H, typename E>
+V& CuckooHashMap<K, V, H, E>::get(const K& key) const {
+  Slot* found = find_slot(key);
+  assert(found != nullptr);
+  return found->val;
+}
+
+template<typename K, typename V, typename H, typename E>
+V* CuckooHashMap<K, V, H, E>::find(const K& key) const {
+  Slot* found = find_slot(key);
+  return found != nullptr ? &found->val : nullptr;
+}
+
+template<typename K, typename V, typename H, typename E>
+void CuckooHashMap<K, V, H, E>::set(const K& key, const V& val) {
+  Slot* found = find_slot(key);
+  if (found != nullptr) {
+    found->val = val;
+  } else {
+    insert_new(key, val);
+  }
+}
+
+template<typename K, typename V, typename H, typename E>
+void CuckooHashMap<K, V, H, E>::erase(const K& key) {
+  size_t hash = hash_of(key);
+  uint8_t tag = tag_of(hash);
+  size_t buckets[2] = {first_bucket(hash), alt_bucket(first_bucket(hash), tag)};
+
+  // no tombstones, a key can only be in its two buckets
+  for (size_t b : buckets) {
+    for (int i = 0; i < kSlotsPerBucket; i++) {
+      if (buckets_[b].tags[i] == tag and eq_fn_(slot(b, i).key, key)) {
+        destroy_slot(b, i);
+        buckets_[b].tags[i] = 0;
+        size_--;
+        return;
+      }
+    }
+  }
+}
+
+template<typename K, typename V, typename H, typename E>
+template<typename... Args>
+typename CuckooHashMap<K, V, H, E>::Slot* CuckooHashMap<K, V, H, E>::insert_new(const K& key, Args&&... args) {
+  if (size_ + 1 > kLoadFactorBound * n_buckets_ * kSlotsPerBucket) {
+    std::vector<Slot> items;
+    drain(&items);
+    rebuild(&items, n_buckets_ * 2);
+  }
+
+  Slot item(key, std::forward<Args>(args)...);
+  size_t hash = hash_of(key);
+  uint8_t tag = tag_of(hash);
+
+  Slot* landed = place(item, &tag, first_bucket(hash));
+  size_++;
+
+  if (landed == nullptr) {
+    // item is now some displaced key, it goes in with the rest
+    std::vector<Slot> items;
+    drain(&items);
+    items.push_back(std::move(item));
+    rebuild(&items, n_buckets_ * 2);
+  }
+
+  // the key may have been displaced or rehashed on the way
+  return landed != nullptr and eq_fn_(landed->key, key) ? landed : find_slot(key);
+}
+
+template<typename K, typename V, typename H, typename E>
+int CuckooHashMap<K, V, H, E>::free_index(const Bucket& bucket) {
+  for (int i = 0; i < kSlotsPerBucket; i++) {
+    if (bucket.tags[i] == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+template<typename K, typename V, typename H, typename E>
+typename CuckooHashMap<K, V, H, E>::Slot* CuckooHashMap<K, V, H, E>::place(Slot& item, uint8_t* tag, size_t b) {
+  for (int kick = 0; kick <= kMaxKicks; kick++) {
+    size_t alt = alt_bucket(b, *tag);
+
+    size_t target = b;
+    int idx = free_index(buckets_[b]);
+    if (idx < 0) {
+      target = alt;
+      idx = free_index(buckets_[alt]);
+    }
+
+    if (idx >= 0) {
+      construct_slot(target, idx, std::move(item));
+      buckets_[target].tags[idx] = *tag;
+      return &slot(target, idx);
+    }
+
+    if (kick == kMaxKicks) {
+      break;
+    }
+
+    // both buckets are full: item takes the place of a random key of one
+    // of them, which goes on to its other bucket
+    uint32_t r = next_random();
+    size_t victim_bucket = (r & 1) ? b : alt;
+    int victim = static_cast<int>((r >> 1) % kSlotsPerBucket);
+
+    std::swap(item, slot(victim_bucket, victim));
+    std::swap(*tag, buckets_[victim_bucket].tags[victim]);
+
+    b = alt_bucket(victim_bucket, *tag);
+  }
+
+  return nullptr;
+}
+
+template<typename K, typename V, typename H, typename E>
+void CuckooHashMap<K, V, H, E>::drain(std::vector<Slot>* items) {
+  items->reserve(items->size() + size_ + 1);
+
+  for (int b = 0; b < n_buckets_; b++) {
+    for (int i = 0; i < kSlotsPerBucket; i++) {
+      if (buckets_[b].tags[i] != 0) {
+        items->push_back(std::move(slot(b, i)));
+        destroy_slot(b, i);
+        buckets_[b].tags[i] = 0;
+      }
+    }
+  }
+}
+
+template<typename K, typename V, typename H, typename E>
+void CuckooHashMap<K, V, H, E>::rebuild(std::vector<Slot>* items, int n_buckets) {
+  for (; ; n_buckets *= 2) {
+    init_buckets(n_buckets);
+
+    size_t placed = 0;
+    for (; placed < items->size(); placed++) {
+      Slot& item = (*items)[placed];
+      size_t hash = hash_of(item.key);
+      uint8_t tag = tag_of(hash);
+
+      if (place(item, &tag, first_bucket(hash)) == nullptr) {
+        break;
+      }
+    }
+
+    if (placed == items->size()) {
+      size_ = static_cast<int>(items->size());
+      return;
+    }
+
+    // the key that did not fit is back in items[placed], the ones before
+    // it are in the table and are taken out again
+    std::vector<Slot> rest;
+    drain(&rest);
+    rest.insert(rest.end(), std::make_move_iterator(items->begin() + placed),
+                std::make_move_iterator(items->end()));
+    items->swap(rest);
+  }
+}
+
+template<typename K, typename V, typename H, typename E>
+void CuckooHashMap<K, V, H, E>::init_buckets(int n_buckets) {
+  // the buckets must be empty, their slots are not destroyed. new[] does
+  // not align beyond max_align_t in C++11, so the array is aligned by hand
+  storage_.reset(new char[n_buckets * sizeof(Bucket) + alignof(Bucket)]);
+
+  void* start = storage_.get();
+  size_t space = n_buckets * sizeof(Bucket) + alignof(Bucket);
+  buckets_ = static_cast<Bucket*>(std::align(alignof(Bucket), n_buckets * sizeof(Bucket), start, space));
+  n_buckets_ = n_buckets;
+
+  for (int b = 0; b < n_buckets_; b++) {
+    std::memset(buckets_[b].tags, 0, sizeof(buckets_[b].tags));
+  }
+}
+
+template<typename K, typename V, typename H, typename E>
+uint32_t CuckooHashMap<K, V, H, E>::next_random() {
+  random_ ^= random_ << 13;
+  random_ ^= random_ >> 17;
+  random_ ^= random_ << 5;
+  return random_;
+}
+
+template<typename K, typename V, typename H, typename E>
+V& CuckooHashMap<K, V, H, E>::operator[](const K& key) {
+  // the value is value initialised in place when the key is absent
+  Slot* found = find_slot(key);
+  if (found == nullptr) {
+    found = insert_new(key);
+  }
+  return found->val;
+}
+
+// the operator[] can be called with const requiring that the key is inserted
+template<typename K, typename V, typename H, typename E>
+V& CuckooHashMap<K, V, H, E>::operator[](const K& key) const {
+  return get(key);
+}
+
+}
+
+#endif
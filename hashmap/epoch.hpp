@@ -0,0 +1,268 @@
+#ifndef HASHMAP_EPOCH_H_
+#define HASHMAP_EPOCH_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace dicts {
+
+// Epoch based reclamation. Readers pin the current epoch while they hold
+// pointers into a shared structure, writers retire what they unlink and it
+// is only freed once every pinned reader has moved two epochs past it.
+//
+// A reader only writes to its own record, padded to a cache line, so
+// readers on different cores never write to the same line. Each manager
+// finds the record of a thread in O(1) through the thread's slot, a small
+// number that threads alive at the same time never share, and frees the
+// records with itself. retire and
+// try_reclaim must not run concurrently with each other, the structures
+// using this class call them under their writer lock.
+class EpochManager {
+  private:
+    struct ThreadRecord;
+
+  public:
+    class Guard {
+      public:
+        explicit Guard(ThreadRecord* record);
+
+        Guard(Guard&& other);
+
+        Guard(const Guard&) = delete;
+
+        Guard& operator=(const Guard&) = delete;
+
+        ~Guard();
+
+      private:
+        ThreadRecord* record_;
+    };
+
+    EpochManager();
+
+    EpochManager(const EpochManager&) = delete;
+
+    EpochManager& operator=(const EpochManager&) = delete;
+
+    ~EpochManager();
+
+    // Pins the calling thread until the guard goes out of scope, guards
+    // can be nested.
+    Guard pin();
+
+    template<typename T>
+    void retire(T* ptr);
+
+    // Advances the epoch if every pinned reader is in the current one and
+    // frees what was retired two epochs ago.
+    void try_reclaim();
+
+  private:
+    struct ThreadRecord {
+        // 0 when the thread is not pinned
+        std::atomic<uint64_t> epoch;
+
+        // only touched by the owner thread
+        int depth;
+
+        ThreadRecord* next;
+
+        char padding[64];
+
+        ThreadRecord(): epoch(0), depth(0), next(nullptr) {}
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        void* ptr;
+        void (*deleter)(void*);
+    };
+
+    template<typename T>
+    static void delete_as(void* ptr) {
+      delete static_cast<T*>(ptr);
+    }
+
+    ThreadRecord* local_record();
+
+    // slot of the calling thread, given back when it exits
+    static int thread_slot();
+
+    // threads alive at the same time that can pin a manager
+    static const int kChunkSlots = 64;
+    static const int kMaxThreads = 64 * kChunkSlots;
+
+    struct RecordChunk {
+        std::atomic<ThreadRecord*> records[kChunkSlots];
+
+        RecordChunk() {
+          for (auto& record : records) {
+            record.store(nullptr, std::memory_order_relaxed);
+          }
+        }
+    };
+
+    std::atomic<uint64_t> global_epoch_;
+
+    // the records by thread slot, in chunks allocated on first use
+    std::atomic<RecordChunk*> chunks_[kMaxThreads / kChunkSlots];
+
+    std::atomic<ThreadRecord*> records_;
+
+    std::vector<Retired> retired_;
+};
+
+
+inline EpochManager::Guard::Guard(ThreadRecord* record): record_(record) {}
+
+inline EpochManager::Guard::Guard(Guard&& other): record_(other.record_) {
+  other.record_ = nullptr;
+}
+
+inline EpochManager::Guard::~Guard() {
+  if (record_ != nullptr and --record_->depth == 0) {
+    record_->epoch.store(0, std::memory_order_release);
+  }
+}
+
+inline EpochManager::EpochManager():
+                global_epoch_(1),
+                records_(nullptr)
+{
+  for (auto& chunk : chunks_) {
+    chunk.store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+inline EpochManager::~EpochManager() {
+  for (auto& retired : retired_) {
+    retired.deleter(retired.ptr);
+  }
+
+  ThreadRecord* record = records_.load();
+  while (record != nullptr) {
+    ThreadRecord* next = record->next;
+    delete record;
+    record = next;
+  }
+
+  for (auto& chunk : chunks_) {
+    delete chunk.load();
+  }
+}
+
+inline int EpochManager::thread_slot() {
+  struct Registry {
+      std::mutex mutex;
+      std::vector<int> free_slots;
+      int next_slot = 0;
+  };
+  static Registry registry;
+
+  // the lowest free slots are handed out again first, so the slots stay
+  // below the number of threads alive at once
+  struct Slot {
+      int id;
+
+      Slot() {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        if (registry.free_slots.empty()) {
+          id = registry.next_slot++;
+        } else {
+          std::pop_heap(registry.free_slots.begin(), registry.free_slots.end(), std::greater<int>());
+          id = registry.free_slots.back();
+          registry.free_slots.pop_back();
+        }
+      }
+
+      ~Slot() {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.free_slots.push_back(id);
+        std::push_heap(registry.free_slots.begin(), registry.free_slots.end(), std::greater<int>());
+      }
+  };
+  static thread_local Slot slot;
+
+  return slot.id;
+}
+
+// A thread that exits leaves its unpinned record behind, the next thread
+// given the same slot takes it over.
+inline EpochManager::ThreadRecord* EpochManager::local_record() {
+  int slot = thread_slot();
+  assert(slot < kMaxThreads);
+
+  std::atomic<RecordChunk*>& chunk_ref = chunks_[slot / kChunkSlots];
+  RecordChunk* chunk = chunk_ref.load(std::memory_order_acquire);
+  if (chunk == nullptr) {
+    RecordChunk* fresh = new RecordChunk();
+    if (chunk_ref.compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel)) {
+      chunk = fresh;
+    } else {
+      delete fresh;
+    }
+  }
+
+  // only the thread owning the slot writes its entry
+  std::atomic<ThreadRecord*>& entry = chunk->records[slot % kChunkSlots];
+  ThreadRecord* record = entry.load(std::memory_order_relaxed);
+  if (record == nullptr) {
+    record = new ThreadRecord();
+    record->next = records_.load();
+    while (!records_.compare_exchange_weak(record->next, record)) {}
+    entry.store(record, std::memory_order_relaxed);
+  }
+
+  return record;
+}
+
+inline EpochManager::Guard EpochManager::pin() {
+  ThreadRecord* record = local_record();
+
+  if (record->depth++ == 0) {
+    // the fence pairs with the one in try_reclaim: either the writer sees
+    // the announcement or this thread sees everything unlinked before it
+    record->epoch.store(global_epoch_.load(), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+
+  return Guard(record);
+}
+
+template<typename T>
+void EpochManager::retire(T* ptr) {
+  Retired retired = {global_epoch_.load(), ptr, &delete_as<T>};
+  retired_.push_back(retired);
+}
+
+inline void EpochManager::try_reclaim() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  uint64_t epoch = global_epoch_.load();
+
+  for (ThreadRecord* record = records_.load(); record != nullptr; record = record->next) {
+    uint64_t pinned = record->epoch.load();
+    if (pinned != 0 and pinned != epoch) {
+      return;
+    }
+  }
+
+  global_epoch_.store(epoch + 1);
+
+  // every pinned reader announced the epoch that just ended, so whatever
+  // was retired in an earlier one is out of their reach
+  auto reclaimable = std::partition(retired_.begin(), retired_.end(),
+                                    [epoch](const Retired& r) { return r.epoch + 1 > epoch; });
+  for (auto it = reclaimable; it != retired_.end(); ++it) {
+    it->deleter(it->ptr);
+  }
+  retired_.erase(reclaimable, retired_.end());
+}
+
+}
+
+#endif
@@ -1,6 +1,46 @@
+#include "cuckoo_hash_map.hpp"
 #include "hash_map.hpp"
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <iostream>
+#include <utility>
+#include <vector>
+
+// FNV-1a over the characters, so a std::string and a const char* with the
+// same contents hash the same and the map can be searched without building
+// a temporary std::string
+struct StringHash {
+  typedef void is_transparent;
+
+  size_t operator()(const char* s) const {
+    return hash_bytes(s, std::strlen(s));
+  }
+
+  size_t operator()(const std::string& s) const {
+    return hash_bytes(s.data(), s.size());
+  }
+
+  static size_t hash_bytes(const char* s, size_t n) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < n; i++) {
+      h = (h ^ static_cast<unsigned char>(s[i])) * 1099511628211ULL;
+    }
+    return static_cast<size_t>(h);
+  }
+};
+
+struct StringEqual {
+  typedef void is_transparent;
+
+  bool operator()(const std::string& a, const std::string& b) const {
+    return a == b;
+  }
+
+  bool operator()(const std::string& a, const char* b) const {
+    return a == b;
+  }
+};
 
 int main(){
   dicts::HashMap<int,std::string> hm;
@@ -15,4 +55,58 @@ int main(){
   std::cout<<hm[-1]<<std::endl;
 
   std::cout<<hm[2]<<std::endl;
+
+  dicts::HashMap<std::string, int, StringHash, StringEqual> words;
+  words.set("one", 1);
+  words.set("two", 2);
+
+  const char* buffer = "two";
+  std::cout<<*words.find(buffer)<<std::endl;
+
+  size_t hash = StringHash()(buffer);
+  std::cout<<(words.find_with_hash(buffer, hash) != nullptr)<<std::endl;
+  std::cout<<(words.find("three") == nullptr)<<std::endl;
+
+  // one allocation for the whole load, the strings are built in place
+  dicts::HashMap<int, std::string> lines;
+  lines.reserve(1000);
+  for (int i = 0; i < 1000; i++) {
+    lines.try_emplace(i, 3, 'x');
+  }
+  lines.insert(1000, std::string("moved in"));
+
+  dicts::HashMap<int, std::string> moved(std::move(lines));
+  std::cout<<moved[1000]<<" "<<moved.size()<<std::endl;
+
+  std::vector<std::pair<std::string, int> > pairs;
+  pairs.push_back(std::make_pair("three", 3));
+  pairs.push_back(std::make_pair("four", 4));
+
+  dicts::HashMap<std::string, int> numbers = dicts::HashMap<std::string, int>::build_from(pairs);
+  for (dicts::HashMap<std::string, int>::ConstIterator it = numbers.begin(); it != numbers.end(); it++) {
+    std::cout<<(*it).first<<" "<<(*it).second<<std::endl;
+  }
+
+  std::cout<<hm.memory_usage()<<std::endl;
+
+  // same interface with Robin Hood probing, which keeps no tombstones
+  dicts::HashMap<int, int, std::hash<int>, std::equal_to<int>, dicts::RobinHoodProbing> robin;
+  for (int i = 0; i < 1000; i++) {
+    robin.set(i, i * i);
+  }
+  for (int i = 0; i < 1000; i += 2) {
+    robin.erase(i);
+  }
+  std::cout<<robin.get(31)<<" "<<robin.size()<<std::endl;
+
+  // only filled in when built with -DDICTS_HASHMAP_STATS
+  hm.dump_stats(std::cout);
+
+  // every lookup checks at most two buckets, each a single cache line here
+  dicts::CuckooHashMap<int, int> cuckoo;
+  for (int i = 0; i < 1000; i++) {
+    cuckoo[i] = i * 2;
+  }
+  cuckoo.erase(10);
+  std::cout<<cuckoo.get(21)<<" "<<(cuckoo.find(10) == nullptr)<<" "<<cuckoo.size()<<std::endl;
 }
@@ -1,241 +1,1335 @@
 #ifndef HASHMAP_HASH_MAP_H_
 #define HASHMAP_HASH_MAP_H_
 
-#include <vector>  
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ctrl_group.hpp"
+#include "hash_map_stats.hpp"
+#include "hash_mix.hpp"
 
 namespace dicts {
 
-template<typename K, typename V, typename H = std::hash<K> >
+namespace internal {
+
+template<typename T>
+struct make_void {
+    typedef void type;
+};
+
+template<typename T, typename = void>
+struct is_transparent : std::false_type {};
+
+template<typename T>
+struct is_transparent<T, typename make_void<typename T::is_transparent>::type> : std::true_type {};
+
+// Q takes part so that the condition is only checked when a lookup with Q
+// is made
+template<typename H, typename E, typename Q>
+struct enable_transparent_lookup
+    : std::enable_if<is_transparent<H>::value and is_transparent<E>::value, Q> {};
+
+}
+
+// Memory taken by a HashMap, as reported by HashMap::memory_usage. Only
+// the map itself and its tables are counted, not what the keys and values
+// allocate on their own.
+struct MemoryUsage {
+    size_t bytes;
+    int entries;
+    int capacity;
+    double bytes_per_entry;
+    double load_factor;
+
+    // fraction of the slots taken by tombstones
+    double tombstone_ratio;
+};
+
+inline std::ostream& operator<< (std::ostream& os, const MemoryUsage& usage) {
+  return os << usage.bytes << " bytes, " << usage.entries << " entries in "
+            << usage.capacity << " slots, " << usage.bytes_per_entry << " bytes/entry, load "
+            << usage.load_factor << ", tombstones " << usage.tombstone_ratio;
+}
+
+// Probing schemes of HashMap, picked with its last template parameter.
+//
+// GroupProbing keeps a 7 bit hash fragment in the control byte of every full
+// slot and visits whole groups of control bytes in triangular order, erase
+// leaves a tombstone when the group has no empty slot.
+struct GroupProbing {};
+
+// RobinHoodProbing probes linearly, one slot at a time, and the control byte
+// of a full slot holds its distance from the home slot of its key. An insert
+// takes the place of the first key that is closer to its home and shifts
+// the rest of the run forward, erase shifts the run back (backward shift
+// deletion). Tables have no tombstones and probe lengths stay short and
+// even near the load factor bound.
+struct RobinHoodProbing {};
+
+template<typename K, typename V, typename H, typename E, typename P>
+class MappedHashMap;
+
+template<typename K, typename V, typename H = std::hash<K>, typename E = std::equal_to<K>,
+         typename P = GroupProbing>
 class HashMap {
+  private:
+    struct Table;
+
   public:
+    // Walks the full slots in table order. Every group of control bytes is
+    // turned into a bit mask of its full slots, so empty and deleted slots
+    // are skipped a whole group at a time without looking at the slots.
+    // Any insert or erase invalidates the iterators.
+    class ConstIterator {
+      public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::pair<const K&, V&> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef void pointer;
+        typedef value_type reference;
+
+        ConstIterator(): table_(nullptr), next_table_(nullptr), group_start_(0), full_(0) {}
+
+        value_type operator*() const {
+          Slot& s = slot(*table_, group_start_ + full_.lowest());
+          return value_type(s.key, s.val);
+        }
+
+        ConstIterator& operator++ () {
+          full_.clear_lowest();
+          skip_to_full();
+          return *this;
+        }
+
+        ConstIterator operator++ (int) {
+          ConstIterator it = *this;
+          ++*this;
+          return it;
+        }
+
+        bool operator== (const ConstIterator& const_it) const {
+          return table_ == const_it.table_ and
+                 (table_ == nullptr or
+                  (group_start_ == const_it.group_start_ and full_.lowest() == const_it.full_.lowest()));
+        }
+
+        bool operator!= (const ConstIterator& const_it) const {
+          return !(*this == const_it);
+        }
+
+      private:
+        friend class HashMap;
+
+        // next_table is walked after table, nullptr when there is none
+        ConstIterator(const Table* table, const Table* next_table):
+                        table_(table),
+                        next_table_(next_table),
+                        group_start_(0),
+                        full_(Group(&table->ctrl[0]).match_full())
+        {
+          skip_to_full();
+        }
+
+        void skip_to_full() {
+          while (!full_.any()) {
+            group_start_ += Group::kWidth;
+
+            if (group_start_ == table_->capacity()) {
+              table_ = next_table_;
+              next_table_ = nullptr;
+              group_start_ = 0;
+
+              if (table_ == nullptr) {
+                return;
+              }
+            }
+            full_ = Group(&table_->ctrl[group_start_]).match_full();
+          }
+        }
+
+        const Table* table_;
+        const Table* next_table_;
+        int group_start_;
+
+        // full slots of the current group that have not been visited
+        internal::BitMask full_;
+    };
+
     HashMap();
-    
+
     HashMap(const HashMap& hm);
-    
+
+    // hm is left empty and usable
+    HashMap(HashMap&& hm);
+
     ~HashMap();
-    
+
+    int size() const;
+
+    // Builds a map out of a range of key/value pairs, e.g. a vector of
+    // std::pair or another map, with a single table allocation. Later
+    // duplicates overwrite earlier ones.
+    template<typename Range>
+    static HashMap build_from(const Range& range);
+
+    ConstIterator begin() const;
+
+    ConstIterator end() const;
+
+    MemoryUsage memory_usage() const;
+
+    // Snapshot of the statistics, which are only collected when
+    // DICTS_HASHMAP_STATS is defined (see hash_map_stats.hpp).
+    HashMapStats stats() const;
+
+    void dump_stats(std::ostream& os) const;
+
     V& get(const K& key) const;
-    
+
+    // Returns a pointer to the value of key, or nullptr when it is absent.
+    V* find(const K& key) const;
+
+    // Lookup with a key of another type, e.g. a const char* in a map of
+    // std::string, available when both H and E declare is_transparent.
+    template<typename Q, typename = typename internal::enable_transparent_lookup<H, E, Q>::type>
+    V* find(const Q& key) const;
+
+    // Same as find for callers that already have hash_fn(key), e.g. because
+    // they used it to pick a shard, so the key is not hashed twice.
+    V* find_with_hash(const K& key, size_t hash) const;
+
+    template<typename Q, typename = typename internal::enable_transparent_lookup<H, E, Q>::type>
+    V* find_with_hash(const Q& key, size_t hash) const;
+
+    // Looks up n keys at once, results[i] is set as find(keys[i]) would.
+    // The keys are hashed and their groups and slots prefetched a chunk at a
+    // time before any of them is compared, so the cache misses of
+    // independent keys overlap instead of being paid one after the other.
+    void find_batch(const K* keys, int n, V** results) const;
+
     void set(const K& key, const V& val);
-    
+
+    // Inserts key with a value built in place from args, an existing value
+    // is left untouched. Returns the value and whether it was inserted.
+    template<typename... Args>
+    std::pair<V*, bool> try_emplace(const K& key, Args&&... args);
+
+    template<typename... Args>
+    std::pair<V*, bool> try_emplace(K&& key, Args&&... args);
+
+    // Like try_emplace, but an existing value is replaced with V(args...).
+    template<typename... Args>
+    V& emplace(const K& key, Args&&... args);
+
+    template<typename... Args>
+    V& emplace(K&& key, Args&&... args);
+
+    // Moves key and val in when key is absent.
+    std::pair<V*, bool> insert(K&& key, V&& val);
+
     void erase(const K& key);
-    
+
+    // set and erase taking hash_fn(key) from the caller, see find_with_hash
+    void set_with_hash(const K& key, const V& val, size_t hash);
+
+    void erase_with_hash(const K& key, size_t hash);
+
     void reorder();
-    
+
+    // Makes room for n keys, so that inserting up to n keys does not
+    // resize the table again.
+    void reserve(int n);
+
+    // Rebuilds the table with at least n_slots slots, or more if the
+    // current keys would not fit, which also drops all the tombstones.
+    void rehash(int n_slots);
+
+    // With incremental resize the table grows by keeping the old slot array
+    // next to the new one, and every set/erase/operator[] moves a bounded
+    // number of groups over, instead of re-inserting everything at once.
+    void set_incremental_resize(bool incremental);
+
     V& operator[](const K& key);
-    
+
     V& operator[](const K& key) const;
-    
-    HashMap<K, V, H>& operator=(const HashMap& hm);
-    
+
+    HashMap<K, V, H, E, P>& operator=(const HashMap& hm);
+
+    HashMap<K, V, H, E, P>& operator=(HashMap&& hm);
+
   private:
-    int effective_hash(const K& key, int offset) const;
-    
-    int find_index(const K& key) const;
-    double loadFactor() const;
-  
-    void set(K* key_ptr, V* val_ptr);
+    // runs the lookups of this class over a mapped snapshot of its table
+    friend class MappedHashMap<K, V, H, E, P>;
 
+    typedef internal::ctrl_t ctrl_t;
+    typedef internal::Group Group;
+
+    // Keys and values live directly in the slot array, the state of every
+    // slot is kept apart in a compact control byte array (see ctrl_group.hpp)
+    // that is scanned a whole group at a time, so probing only touches a slot
+    // when its hash fragment matches.
     struct Slot {
-        enum class State{USED, UNUSED, DELETED};
-        K* key;
-        V* val;
-        State state;
-        
-        Slot(): key(nullptr),
-                val(nullptr)
-        {
-          state = State::UNUSED;
-        }
-        
-        // the pointers are deleted manually through the vector associated by it,
-        // see the code in reorder 
-        ~Slot(){}
-        
+        K key;
+        V val;
+
+        // the value is built from args, value initialised when there are none
+        template<typename KK, typename... Args>
+        Slot(KK&& k, Args&&... args): key(std::forward<KK>(k)), val(std::forward<Args>(args)...) {}
+    };
+
+    typedef typename std::aligned_storage<sizeof(Slot), alignof(Slot)>::type SlotStorage;
+
+    struct Table {
+        std::vector<ctrl_t> ctrl;
+
+        // uninitialised, only the slots with a full control byte are alive
+        std::unique_ptr<SlotStorage[]> data;
+
+        // full and deleted slots, both lengthen the probe sequences
+        int used_slots;
+
+        // deleted slots (tombstones) among the used ones
+        int deleted_slots;
+
+        Table(): used_slots(0), deleted_slots(0) {}
+
+        int capacity() const { return static_cast<int>(ctrl.size()); }
     };
-    
-    static const int kInitDataSize = 100;
-    
-    const double kLoadFactorBound = 0.4;
-    
+
+    template<typename Q>
+    size_t hash_of(const Q& key) const;
+
+    template<typename T>
+    static int effective_hash(const T& table, size_t hash, int offset);
+
+    static ctrl_t fragment(size_t hash);
+
+    // The lookup helpers take any table type T with the ctrl, data,
+    // deleted_slots and capacity() of Table, so that they also run over a
+    // MappedHashMap, whose table is not owned.
+    template<typename T>
+    static Slot& slot(const T& table, int idx);
+
+    template<typename T, typename Q>
+    int find_index(const T& table, const Q& key, size_t hash) const;
+
+    template<typename T, typename Q>
+    int find_index(const T& table, const Q& key, size_t hash, GroupProbing) const;
+
+    template<typename T, typename Q>
+    int find_index(const T& table, const Q& key, size_t hash, RobinHoodProbing) const;
+
+    static int find_free_index(const Table& table, size_t hash);
+
+    // Takes a slot for a key that is absent and returns it, the control byte
+    // and the counters are updated and the slot is left to be constructed.
+    int claim_slot(Table& table, size_t hash);
+
+    int claim_slot(Table& table, size_t hash, GroupProbing);
+
+    int claim_slot(Table& table, size_t hash, RobinHoodProbing);
+
+    // destroys the slot at idx and frees it
+    void erase_at(Table& table, int idx);
+
+    void erase_at(Table& table, int idx, GroupProbing);
+
+    void erase_at(Table& table, int idx, RobinHoodProbing);
+
+    // where the probe sequence of hash starts, and the slot that holds the
+    // key most of the time, -1 when it is certainly not there
+    template<typename T>
+    static int home_slot(const T& table, size_t hash, GroupProbing);
+
+    template<typename T>
+    static int home_slot(const T& table, size_t hash, RobinHoodProbing);
+
+    static int first_candidate(const Table& table, size_t hash, GroupProbing);
+
+    static int first_candidate(const Table& table, size_t hash, RobinHoodProbing);
+
+    // distance of the key at idx from its home slot, with RobinHoodProbing
+    template<typename T>
+    int distance(const T& table, int idx) const;
+
+    static ctrl_t distance_ctrl(int distance);
+
+    template<typename Q>
+    Slot* find_slot(const Q& key, size_t hash) const;
+
+    // returns the slot of key and whether it was inserted, in which case
+    // the slot is built from key and args
+    template<typename KK, typename... Args>
+    std::pair<Slot*, bool> find_or_insert(size_t hash, KK&& key, Args&&... args);
+
+    template<typename KK, typename... Args>
+    Slot* insert_new(size_t hash, KK&& key, Args&&... args);
+
+    static void insert_at(Table& table, int idx, size_t hash);
+
+    static double loadFactor(const Table& table);
+
+    static void init_table(Table& table, int n_slots);
+
+    static void destroy_slots(Table& table);
+
+    static void move_slot(Table& table, int from, int to);
+
+    // makes the current table the old one and starts over with n_slots
+    void start_resize(int n_slots);
+
+    // slots needed to hold n keys under kLoadFactorBound
+    int slots_for(int n) const;
+
+    void rehash_in_place(Table& table);
+
+    bool migrating() const;
+
+    void migrate_step(int n_groups);
+
+    void complete_migration();
+
+    void clear();
+
+    // no-ops unless DICTS_HASHMAP_STATS is defined
+    void record_probe(int length) const;
+
+    void record_lookup(bool hit) const;
+
+    void record_load();
+
+    // the number of slots is always a power of two
+    static const int kInitDataSize = 128;
+
+    // larger Robin Hood distances are stored as kMaxDistance and computed
+    // again from the key when they are needed
+    static const ctrl_t kMaxDistance = 127;
+
+    // keys of find_batch whose cache misses are overlapped
+    static const int kBatchChunk = 32;
+
+    // groups moved to the new table by every mutating operation while an
+    // incremental resize is in progress
+    static const int kMigrateGroups = 4;
+
+    const double kLoadFactorBound = 0.875;
+
     const H hash_fn_;
-    
-    int used_slots_;
-    
-    std::vector<Slot> data_; 
-    
-};  
 
+    const E eq_fn_;
+
+    bool incremental_resize_;
+
+    Table table_;
+
+    // the table being drained by an incremental resize, empty otherwise
+    Table old_table_;
+
+    // first slot of old_table_ that has not been migrated yet
+    int migrate_pos_;
+
+#ifdef DICTS_HASHMAP_STATS
+    mutable internal::StatsCounters stats_;
+#endif
+
+};
+
+
+
+template<typename K, typename V, typename H, typename E, typename P>
+const int HashMap<K, V, H, E, P>::kInitDataSize;
+
+template<typename K, typename V, typename H, typename E, typename P>
+const int HashMap<K, V, H, E, P>::kBatchChunk;
 
+template<typename K, typename V, typename H, typename E, typename P>
+const int HashMap<K, V, H, E, P>::kMigrateGroups;
 
-template<typename K, typename V, typename H >
-HashMap<K,V,H>::HashMap(): 
-                hash_fn_(H()) 
+template<typename K, typename V, typename H, typename E, typename P>
+HashMap<K, V, H, E, P>::HashMap():
+                hash_fn_(H()),
+                eq_fn_(E()),
+                incremental_resize_(false),
+                migrate_pos_(0)
 {
-                used_slots_ = 0;
-                data_.resize(kInitDataSize);
+                init_table(table_, kInitDataSize);
 }
 
-template<typename K, typename V, typename H >
-HashMap<K, V, H>::HashMap(const HashMap& hm) {
+template<typename K, typename V, typename H, typename E, typename P>
+HashMap<K, V, H, E, P>::HashMap(const HashMap& hm):
+                hash_fn_(hm.hash_fn_),
+                eq_fn_(hm.eq_fn_),
+                incremental_resize_(hm.incremental_resize_),
+                migrate_pos_(0)
+{
+  init_table(table_, kInitDataSize);
+
   *this = hm;
 }
 
-template<typename K, typename V, typename H >
-HashMap<K, V, H>& HashMap<K, V, H>::operator= (const HashMap& hm) {
-  for(auto& slot_iter: data_) {
-    if (slot_iter.state != Slot::State::UNUSED) {
-      delete slot_iter.key;
-      slot_iter.key = nullptr;
+template<typename K, typename V, typename H, typename E, typename P>
+HashMap<K, V, H, E, P>::HashMap(HashMap&& hm):
+                hash_fn_(hm.hash_fn_),
+                eq_fn_(hm.eq_fn_),
+                incremental_resize_(hm.incremental_resize_),
+                migrate_pos_(0)
+{
+  init_table(table_, kInitDataSize);
+
+  *this = std::move(hm);
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+HashMap<K, V, H, E, P>& HashMap<K, V, H, E, P>::operator= (const HashMap& hm) {
+  if (this == &hm) {
+    return *this;
+  }
+
+  clear();
+  reserve(hm.size());
+
+  for (ConstIterator it = hm.begin(); it != hm.end(); ++it) {
+    this->set((*it).first, (*it).second);
+  }
+
+  return *this;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+HashMap<K, V, H, E, P>& HashMap<K, V, H, E, P>::operator= (HashMap&& hm) {
+  if (this == &hm) {
+    return *this;
+  }
+
+  // the slots are not touched, hm gets the emptied tables of this map
+  clear();
+  std::swap(table_, hm.table_);
+  std::swap(old_table_, hm.old_table_);
+  std::swap(migrate_pos_, hm.migrate_pos_);
+  incremental_resize_ = hm.incremental_resize_;
+
+  return *this;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+int HashMap<K, V, H, E, P>::size() const {
+  return table_.used_slots - table_.deleted_slots +
+         old_table_.used_slots - old_table_.deleted_slots;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename Range>
+HashMap<K, V, H, E, P> HashMap<K, V, H, E, P>::build_from(const Range& range) {
+  HashMap hm;
+  hm.reserve(static_cast<int>(std::distance(std::begin(range), std::end(range))));
+
+  for (const auto& kv : range) {
+    hm.set(kv.first, kv.second);
+  }
+
+  return hm;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+typename HashMap<K, V, H, E, P>::ConstIterator HashMap<K, V, H, E, P>::begin() const {
+  return ConstIterator(&table_, migrating() ? &old_table_ : nullptr);
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+typename HashMap<K, V, H, E, P>::ConstIterator HashMap<K, V, H, E, P>::end() const {
+  return ConstIterator();
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+HashMapStats HashMap<K, V, H, E, P>::stats() const {
+  HashMapStats stats;
+
+#ifdef DICTS_HASHMAP_STATS
+  stats_.fill(&stats);
+  stats.tombstones = table_.deleted_slots + old_table_.deleted_slots;
+  stats.load_factor = static_cast<double>(size()) / table_.capacity();
+#endif
+
+  return stats;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::dump_stats(std::ostream& os) const {
+  os << stats();
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::record_probe(int length) const {
+#ifdef DICTS_HASHMAP_STATS
+  stats_.record_probe(length);
+#else
+  (void) length;
+#endif
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::record_lookup(bool hit) const {
+#ifdef DICTS_HASHMAP_STATS
+  stats_.record_lookup(hit);
+#else
+  (void) hit;
+#endif
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::record_load() {
+#ifdef DICTS_HASHMAP_STATS
+  double load = static_cast<double>(table_.used_slots - table_.deleted_slots) / table_.capacity();
+  stats_.peak_load_factor = std::max(stats_.peak_load_factor, load);
+#endif
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+MemoryUsage HashMap<K, V, H, E, P>::memory_usage() const {
+  MemoryUsage usage;
+  usage.entries = size();
+  usage.capacity = table_.capacity() + old_table_.capacity();
+  usage.bytes = sizeof(*this) + usage.capacity * (sizeof(ctrl_t) + sizeof(SlotStorage));
+
+  int deleted = table_.deleted_slots + old_table_.deleted_slots;
+  usage.bytes_per_entry = usage.entries > 0 ? static_cast<double>(usage.bytes) / usage.entries : 0;
+  usage.load_factor = static_cast<double>(usage.entries) / usage.capacity;
+  usage.tombstone_ratio = static_cast<double>(deleted) / usage.capacity;
+
+  return usage;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::init_table(Table& table, int n_slots) {
+  // the table is made of a power of two number of whole groups
+  int n_groups = 1;
+  while (n_groups * Group::kWidth < n_slots) {
+    n_groups *= 2;
+  }
+
+  table.used_slots = 0;
+  table.deleted_slots = 0;
+  table.ctrl.assign(n_groups * Group::kWidth, internal::kEmpty);
+  table.data.reset(new SlotStorage[n_groups * Group::kWidth]);
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename T>
+typename HashMap<K, V, H, E, P>::Slot& HashMap<K, V, H, E, P>::slot(const T& table, int idx) {
+  return *reinterpret_cast<Slot*>(&table.data[idx]);
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename Q>
+size_t HashMap<K, V, H, E, P>::hash_of(const Q& key) const {
+  return static_cast<size_t>(internal::mix_hash(hash_fn_(key)));
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename T>
+int HashMap<K, V, H, E, P>::effective_hash(const T& table, size_t hash, int offset) {
+  // effective_hash uses triangular probing over whole groups, with a power of
+  // two number of groups it visits every group once. It returns the first
+  // slot of the group
+  size_t group_mask = static_cast<size_t>(table.capacity()) / Group::kWidth - 1;
+  size_t triangle = static_cast<size_t>(offset) * (offset + 1) / 2;
+  return static_cast<int>(((hash >> 7) + triangle) & group_mask) * Group::kWidth;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+typename HashMap<K, V, H, E, P>::ctrl_t HashMap<K, V, H, E, P>::fragment(size_t hash) {
+  // the low 7 bits are the fragment, the rest of the hash picks the group
+  return static_cast<ctrl_t>(hash & 0x7F);
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename T, typename Q>
+int HashMap<K, V, H, E, P>::find_index(const T& table, const Q& key, size_t hash) const {
+  return find_index(table, key, hash, P());
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename T, typename Q>
+int HashMap<K, V, H, E, P>::find_index(const T& table, const Q& key, size_t hash, GroupProbing) const {
+  ctrl_t h2 = fragment(hash);
+
+  for (int offset = 0; ; offset++) {
+    int group_start = effective_hash(table, hash, offset);
+    Group group(&table.ctrl[group_start]);
+
+    // full comparisons only happen on fragment matches
+    for (internal::BitMask match = group.match(h2); match.any(); match.clear_lowest()) {
+      int idx = group_start + match.lowest();
+      if (eq_fn_(slot(table, idx).key, key)) {
+        record_probe(offset + 1);
+        return idx;
+      }
+    }
+
+    // an empty slot ends the probe sequence of every key that reaches it
+    if (group.match_empty().any()) {
+      record_probe(offset + 1);
+      return -1;
+    }
+  }
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename T, typename Q>
+int HashMap<K, V, H, E, P>::find_index(const T& table, const Q& key, size_t hash, RobinHoodProbing) const {
+  int mask = table.capacity() - 1;
+  int home = home_slot(table, hash, RobinHoodProbing());
+
+  int offset = 0;
+
+  // the first group is matched in one go, unless it would run past the end
+  // of the table or the table has tombstones (only an old table being
+  // drained has them)
+  if (home + Group::kWidth <= table.capacity() and table.deleted_slots == 0) {
+    Group group(&table.ctrl[home]);
+    internal::BitMask closer = group.match_closer();
+    int end = closer.any() ? closer.lowest() : Group::kWidth;
+
+    for (internal::BitMask match = group.match_distance(); match.any() and match.lowest() < end;
+         match.clear_lowest()) {
+      if (eq_fn_(slot(table, home + match.lowest()).key, key)) {
+        record_probe(match.lowest() + 1);
+        return home + match.lowest();
+      }
+    }
+
+    if (end < Group::kWidth) {
+      record_probe(end + 1);
+      return -1;
+    }
+    offset = Group::kWidth;
+  }
+
+  for (; ; offset++) {
+    int idx = (home + offset) & mask;
+    ctrl_t c = table.ctrl[idx];
+
+    // only a key at its own distance can match, and the key would have
+    // taken the place of any key closer to its home. kEmpty is below every
+    // distance, so it ends the probe too
+    if (c == offset) {
+      if (eq_fn_(slot(table, idx).key, key)) {
+        record_probe(offset + 1);
+        return idx;
+      }
+    } else if (c < offset) {
+      // the keys of the old table never move while it is drained, so its
+      // tombstones are probed through
+      if (c == internal::kDeleted) {
+        continue;
+      }
+
+      int dist = c != kMaxDistance ? c : distance(table, idx);
+      if (dist < offset) {
+        record_probe(offset + 1);
+        return -1;
+      }
+      if (dist == offset and eq_fn_(slot(table, idx).key, key)) {
+        record_probe(offset + 1);
+        return idx;
+      }
+    }
+  }
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+int HashMap<K, V, H, E, P>::find_free_index(const Table& table, size_t hash) {
+  // the first tombstone along the probe sequence is reused, the key is known
+  // to be absent so it does not matter what comes after it
+  for (int offset = 0; ; offset++) {
+    int group_start = effective_hash(table, hash, offset);
+    internal::BitMask free = Group(&table.ctrl[group_start]).match_empty_or_deleted();
+
+    if (free.any()) {
+      return group_start + free.lowest();
+    }
+  }
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename Q>
+typename HashMap<K, V, H, E, P>::Slot* HashMap<K, V, H, E, P>::find_slot(const Q& key, size_t hash) const {
+  int idx = find_index(table_, key, hash);
+  if (idx >= 0) {
+    record_lookup(true);
+    return &slot(table_, idx);
+  }
+
+  // keys that have not been migrated yet are still in the old table
+  if (migrating()) {
+    idx = find_index(old_table_, key, hash);
+    if (idx >= 0) {
+      record_lookup(true);
+      return &slot(old_table_, idx);
+    }
+  }
+
+  record_lookup(false);
+  return nullptr;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+V& HashMap<K, V, H, E, P>::get(const K& key) const {
+  Slot* found = find_slot(key, hash_of(key));
+  assert(found != nullptr);
+  return found->val;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+V* HashMap<K, V, H, E, P>::find(const K& key) const {
+  Slot* found = find_slot(key, hash_of(key));
+  return found != nullptr ? &found->val : nullptr;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename Q, typename>
+V* HashMap<K, V, H, E, P>::find(const Q& key) const {
+  Slot* found = find_slot(key, hash_of(key));
+  return found != nullptr ? &found->val : nullptr;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+V* HashMap<K, V, H, E, P>::find_with_hash(const K& key, size_t hash) const {
+  Slot* found = find_slot(key, static_cast<size_t>(internal::mix_hash(hash)));
+  return found != nullptr ? &found->val : nullptr;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename Q, typename>
+V* HashMap<K, V, H, E, P>::find_with_hash(const Q& key, size_t hash) const {
+  Slot* found = find_slot(key, static_cast<size_t>(internal::mix_hash(hash)));
+  return found != nullptr ? &found->val : nullptr;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::find_batch(const K* keys, int n, V** results) const {
+  size_t hashes[kBatchChunk];
+  int candidates[kBatchChunk];
+
+  for (int chunk = 0; chunk < n; chunk += kBatchChunk) {
+    int chunk_size = std::min(kBatchChunk, n - chunk);
+
+    // hash everything and bring in the home groups
+    for (int i = 0; i < chunk_size; i++) {
+      hashes[i] = hash_of(keys[chunk + i]);
+      internal::prefetch(&table_.ctrl[home_slot(table_, hashes[i], P())]);
     }
-    
-    if (slot_iter.state == Slot::State::USED) {
-      delete slot_iter.val;
-      slot_iter.val = nullptr;
+
+    // e.g. the first fragment match of the home group
+    for (int i = 0; i < chunk_size; i++) {
+      candidates[i] = first_candidate(table_, hashes[i], P());
+      if (candidates[i] >= 0) {
+        internal::prefetch(&table_.data[candidates[i]]);
+      }
+    }
+
+    // anything that is not a hit on the first candidate takes the usual path
+    for (int i = 0; i < chunk_size; i++) {
+      Slot* found = nullptr;
+      if (candidates[i] >= 0 and eq_fn_(slot(table_, candidates[i]).key, keys[chunk + i])) {
+        found = &slot(table_, candidates[i]);
+        record_probe(1);
+        record_lookup(true);
+      } else {
+        found = find_slot(keys[chunk + i], hashes[i]);
+      }
+
+      results[chunk + i] = found != nullptr ? &found->val : nullptr;
     }
   }
-  
-  for(auto& slot_iter : hm.data_){
-    if (slot_iter.state == Slot::State::USED){
-      this->set(*slot_iter.key, *slot_iter.val);
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::insert_at(Table& table, int idx, size_t hash) {
+  if (table.ctrl[idx] == internal::kDeleted) {
+    table.deleted_slots--;
+  } else {
+    table.used_slots++;
+  }
+
+  table.ctrl[idx] = fragment(hash);
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename KK, typename... Args>
+typename HashMap<K, V, H, E, P>::Slot* HashMap<K, V, H, E, P>::insert_new(size_t hash, KK&& key, Args&&... args) {
+  // growing before the insert keeps the returned slot valid. When a good
+  // part of the used slots are tombstones the table is only cleaned up
+  if (static_cast<double>(table_.used_slots + 1) / table_.capacity() > kLoadFactorBound) {
+    if (table_.deleted_slots * 4 >= table_.used_slots) {
+      rehash_in_place(table_);
+    } else {
+      reorder();
     }
   }
-  
-  return *this;  
+
+  int idx = claim_slot(table_, hash);
+  new (&table_.data[idx]) Slot(std::forward<KK>(key), std::forward<Args>(args)...);
+  record_load();
+
+  return &slot(table_, idx);
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename T>
+int HashMap<K, V, H, E, P>::home_slot(const T& table, size_t hash, GroupProbing) {
+  return effective_hash(table, hash, 0);
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename T>
+int HashMap<K, V, H, E, P>::home_slot(const T& table, size_t hash, RobinHoodProbing) {
+  return static_cast<int>(hash & static_cast<size_t>(table.capacity() - 1));
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+int HashMap<K, V, H, E, P>::first_candidate(const Table& table, size_t hash, GroupProbing) {
+  int group_start = effective_hash(table, hash, 0);
+  internal::BitMask match = Group(&table.ctrl[group_start]).match(fragment(hash));
+  return match.any() ? group_start + match.lowest() : -1;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+int HashMap<K, V, H, E, P>::first_candidate(const Table& table, size_t hash, RobinHoodProbing) {
+  int home = home_slot(table, hash, RobinHoodProbing());
+  return table.ctrl[home] == 0 ? home : -1;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename T>
+int HashMap<K, V, H, E, P>::distance(const T& table, int idx) const {
+  if (table.ctrl[idx] < kMaxDistance) {
+    return table.ctrl[idx];
+  }
+
+  int home = home_slot(table, hash_of(slot(table, idx).key), RobinHoodProbing());
+  return (idx - home) & (table.capacity() - 1);
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+typename HashMap<K, V, H, E, P>::ctrl_t HashMap<K, V, H, E, P>::distance_ctrl(int distance) {
+  return static_cast<ctrl_t>(std::min(distance, static_cast<int>(kMaxDistance)));
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+int HashMap<K, V, H, E, P>::claim_slot(Table& table, size_t hash) {
+  return claim_slot(table, hash, P());
 }
 
-template<typename K, typename V, typename H >
-int HashMap<K,V,H>::effective_hash(const K& key, int offset) const {
-  // effective_hash uses Quadratic probing
-  return (hash_fn_(key) % data_.size() + offset + offset * offset) % data_.size();
+template<typename K, typename V, typename H, typename E, typename P>
+int HashMap<K, V, H, E, P>::claim_slot(Table& table, size_t hash, GroupProbing) {
+  int idx = find_free_index(table, hash);
+  insert_at(table, idx, hash);
+  return idx;
 }
 
-template<typename K, typename V, typename H >
-int HashMap<K, V, H>::find_index(const K& key) const {
-  
+template<typename K, typename V, typename H, typename E, typename P>
+int HashMap<K, V, H, E, P>::claim_slot(Table& table, size_t hash, RobinHoodProbing) {
+  int mask = table.capacity() - 1;
+  int home = home_slot(table, hash, RobinHoodProbing());
+
+  // the key goes to the first empty slot or the first slot whose key is
+  // closer to its home than this one would be
   int offset = 0;
-  int idx = effective_hash(key, offset);
-  
-  while(data_[idx].state != Slot::State::UNUSED and *data_[idx].key != key ) {
+  int idx = home;
+  while (table.ctrl[idx] != internal::kEmpty and distance(table, idx) >= offset) {
     offset++;
-    idx = effective_hash(key, offset);
+    idx = (home + offset) & mask;
+  }
+
+  // the keys from idx to the next empty slot move one slot forward
+  int end = idx;
+  while (table.ctrl[end] != internal::kEmpty) {
+    end = (end + 1) & mask;
+  }
+
+  for (int to = end; to != idx; ) {
+    int from = (to - 1) & mask;
+    int dist = distance(table, from);
+
+    move_slot(table, from, to);
+    table.ctrl[to] = distance_ctrl(dist + 1);
+    to = from;
   }
-  
+
+  table.ctrl[idx] = distance_ctrl(offset);
+  table.used_slots++;
   return idx;
 }
 
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename KK, typename... Args>
+std::pair<typename HashMap<K, V, H, E, P>::Slot*, bool>
+HashMap<K, V, H, E, P>::find_or_insert(size_t hash, KK&& key, Args&&... args) {
+  if (migrating()) {
+    migrate_step(kMigrateGroups);
+  }
+
+  Slot* found = find_slot(key, hash);
+  if (found != nullptr) {
+    return std::make_pair(found, false);
+  }
+
+  return std::make_pair(insert_new(hash, std::forward<KK>(key), std::forward<Args>(args)...), true);
+}
 
-template<typename K, typename V, typename H >
-V& HashMap<K,V,H>::get(const K& key) const {
-  int idx = find_index(key);
-  return *data_[idx].val;
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::set(const K& key, const V& val) {
+  set_with_hash(key, val, hash_fn_(key));
 }
 
-template<typename K, typename V, typename H>
-void HashMap<K, V, H>::set(K* key_ptr, V* val_ptr) {
-  int idx = find_index(*key_ptr);
-  
-  if (data_[idx].val != nullptr){
-    delete data_[idx].val;
-    delete data_[idx].key;
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::set_with_hash(const K& key, const V& val, size_t hash) {
+  std::pair<Slot*, bool> res = find_or_insert(static_cast<size_t>(internal::mix_hash(hash)), key, val);
+
+  if (!res.second) {
+    res.first->val = val;
   }
-  
-  data_[idx].key = key_ptr;
-  data_[idx].val = val_ptr;
-  
-  if (data_[idx].state == Slot::State::UNUSED) {
-    used_slots_++;
-    data_[idx].state = Slot::State::USED;
-    
-    if(loadFactor() > kLoadFactorBound) {
-      reorder();
-    } 
-    
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename... Args>
+std::pair<V*, bool> HashMap<K, V, H, E, P>::try_emplace(const K& key, Args&&... args) {
+  std::pair<Slot*, bool> res = find_or_insert(hash_of(key), key, std::forward<Args>(args)...);
+  return std::make_pair(&res.first->val, res.second);
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename... Args>
+std::pair<V*, bool> HashMap<K, V, H, E, P>::try_emplace(K&& key, Args&&... args) {
+  // hashed before the key is moved from
+  size_t hash = hash_of(key);
+  std::pair<Slot*, bool> res = find_or_insert(hash, std::move(key), std::forward<Args>(args)...);
+  return std::make_pair(&res.first->val, res.second);
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename... Args>
+V& HashMap<K, V, H, E, P>::emplace(const K& key, Args&&... args) {
+  std::pair<Slot*, bool> res = find_or_insert(hash_of(key), key, std::forward<Args>(args)...);
+
+  // args were not used when the key was already there
+  if (!res.second) {
+    res.first->val = V(std::forward<Args>(args)...);
+  }
+  return res.first->val;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+template<typename... Args>
+V& HashMap<K, V, H, E, P>::emplace(K&& key, Args&&... args) {
+  size_t hash = hash_of(key);
+  std::pair<Slot*, bool> res = find_or_insert(hash, std::move(key), std::forward<Args>(args)...);
+
+  if (!res.second) {
+    res.first->val = V(std::forward<Args>(args)...);
+  }
+  return res.first->val;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+std::pair<V*, bool> HashMap<K, V, H, E, P>::insert(K&& key, V&& val) {
+  return try_emplace(std::move(key), std::move(val));
+}
+
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::erase(const K& key) {
+  erase_with_hash(key, hash_fn_(key));
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::erase_with_hash(const K& key, size_t hash) {
+  if (migrating()) {
+    migrate_step(kMigrateGroups);
+  }
+
+  hash = static_cast<size_t>(internal::mix_hash(hash));
+  Table* table = &table_;
+  int idx = find_index(table_, key, hash);
+
+  if (idx < 0 and migrating()) {
+    table = &old_table_;
+    idx = find_index(old_table_, key, hash);
+  }
+
+  if (idx < 0) {
+    return;
+  }
+
+  erase_at(*table, idx);
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::erase_at(Table& table, int idx) {
+  erase_at(table, idx, P());
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::erase_at(Table& table, int idx, GroupProbing) {
+  slot(table, idx).~Slot();
+
+  // probe sequences never go past a group that has an empty slot, so in
+  // that case nothing needs the tombstone
+  int group_start = idx - idx % Group::kWidth;
+  if (Group(&table.ctrl[group_start]).match_empty().any()) {
+    table.ctrl[idx] = internal::kEmpty;
+    table.used_slots--;
+  } else {
+    table.ctrl[idx] = internal::kDeleted;
+    table.deleted_slots++;
+  }
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::erase_at(Table& table, int idx, RobinHoodProbing) {
+  slot(table, idx).~Slot();
+
+  // the keys of the old table must stay where they are while it is drained
+  if (&table == &old_table_) {
+    table.ctrl[idx] = internal::kDeleted;
+    table.deleted_slots++;
+    return;
+  }
+
+  // the keys after idx that are not in their home slot move one slot back,
+  // which leaves the table as if the erased key had never been inserted
+  int mask = table.capacity() - 1;
+  int hole = idx;
+  for (int next = (hole + 1) & mask; table.ctrl[next] != internal::kEmpty and table.ctrl[next] != 0;
+       next = (hole + 1) & mask) {
+    int dist = distance(table, next);
+
+    move_slot(table, next, hole);
+    table.ctrl[hole] = distance_ctrl(dist - 1);
+    hole = next;
+  }
+
+  table.ctrl[hole] = internal::kEmpty;
+  table.used_slots--;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::reorder(){
+#ifdef DICTS_HASHMAP_STATS
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#endif
+
+  // the current table is drained into a table twice its size, all at once
+  // unless the resize is incremental
+  start_resize(table_.capacity() * 2);
+
+  if (!incremental_resize_) {
+    complete_migration();
   }
-  
+
+#ifdef DICTS_HASHMAP_STATS
+  std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+  stats_.record_reorder(static_cast<uint64_t>(elapsed.count()));
+#endif
 }
 
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::reserve(int n) {
+  int n_slots = slots_for(n);
 
-template<typename K, typename V, typename H>
-void HashMap<K, V, H>::set(const K& key, const V& val) {
-  set(new K(key), new V(val));
+  if (n_slots > table_.capacity()) {
+    rehash(n_slots);
+  } else {
+    complete_migration();
+  }
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::rehash(int n_slots) {
+  start_resize(std::max(n_slots, slots_for(size())));
+  complete_migration();
 }
 
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::start_resize(int n_slots) {
+  complete_migration();
 
-template<typename K, typename V, typename H>
-void HashMap<K, V, H>::erase(const K& key) {
-  int idx = find_index(key);
-  data_[idx].state = Slot::State::DELETED;
-  
-  delete data_[idx].val;
+  std::swap(old_table_, table_);
+  init_table(table_, n_slots);
+  migrate_pos_ = 0;
 }
 
-template<typename K, typename V, typename H>
-void HashMap<K, V, H>::reorder(){
-  std::vector<Slot> data_copy = data_;
-  
-  for (auto& slot_old : data_) {
-    slot_old.state = Slot::State::UNUSED;
-    slot_old.key = nullptr;
-    slot_old.val = nullptr;
+template<typename K, typename V, typename H, typename E, typename P>
+int HashMap<K, V, H, E, P>::slots_for(int n) const {
+  // insert_new grows once the next key would go over the bound
+  return static_cast<int>(n / kLoadFactorBound) + 1;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::move_slot(Table& table, int from, int to) {
+  new (&table.data[to]) Slot(std::move(slot(table, from)));
+  slot(table, from).~Slot();
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::rehash_in_place(Table& table) {
+  // Drops every tombstone without allocating. The live slots are first
+  // marked deleted and the tombstones empty, then each live slot is put back
+  // at the first free position of its probe sequence, which is either in its
+  // own group, an empty slot or a live slot still to be processed (swapped).
+#ifdef DICTS_HASHMAP_STATS
+  stats_.in_place_rehashes++;
+#endif
+
+  for (int i = 0; i < table.capacity(); i++) {
+    table.ctrl[i] = internal::is_full(table.ctrl[i]) ? internal::kDeleted : internal::kEmpty;
   }
-  
-  used_slots_ = 0;
-  data_.resize(data_.size() * 2);
-  
-  for(auto& slot_iter : data_copy) {
 
-    if (slot_iter.state == Slot::State::USED) {
-      set(slot_iter.key, slot_iter.val);
+  for (int i = 0; i < table.capacity(); i++) {
+    if (table.ctrl[i] != internal::kDeleted) {
+      continue;
     }
-    else if (slot_iter.state == Slot::State::DELETED) {
-      delete slot_iter.key;
-      slot_iter.key = nullptr;
+
+    size_t hash = hash_of(slot(table, i).key);
+    int new_idx = find_free_index(table, hash);
+
+    if (new_idx / Group::kWidth == i / Group::kWidth) {
+      table.ctrl[i] = fragment(hash);
+    } else if (table.ctrl[new_idx] == internal::kEmpty) {
+      move_slot(table, i, new_idx);
+      table.ctrl[new_idx] = fragment(hash);
+      table.ctrl[i] = internal::kEmpty;
+    } else {
+      // new_idx holds a live slot that has not been placed yet, it is
+      // swapped into i and processed on the next iteration
+      SlotStorage tmp;
+      new (&tmp) Slot(std::move(slot(table, new_idx)));
+      slot(table, new_idx).~Slot();
+
+      move_slot(table, i, new_idx);
+      table.ctrl[new_idx] = fragment(hash);
+
+      Slot& tmp_slot = *reinterpret_cast<Slot*>(&tmp);
+      new (&table.data[i]) Slot(std::move(tmp_slot));
+      tmp_slot.~Slot();
+      i--;
     }
   }
-  
+
+  table.used_slots -= table.deleted_slots;
+  table.deleted_slots = 0;
 }
 
-template<typename K, typename V, typename H>
-double HashMap<K, V, H>::loadFactor() const {
-  return static_cast<double>(used_slots_) / data_.size();
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::set_incremental_resize(bool incremental) {
+  incremental_resize_ = incremental;
+
+  if (!incremental_resize_) {
+    complete_migration();
+  }
 }
 
-template<typename K, typename V, typename H>
-HashMap<K, V, H>::~HashMap(){
-  for (auto& slot_iter : data_){
-    if (slot_iter.state != Slot::State::UNUSED){
-      delete slot_iter.key;
-      slot_iter.key = nullptr;
-      
-      if (slot_iter.state == Slot::State::USED){
-        delete slot_iter.val;
-        slot_iter.val = nullptr;
-      }
+template<typename K, typename V, typename H, typename E, typename P>
+bool HashMap<K, V, H, E, P>::migrating() const {
+  return !old_table_.ctrl.empty();
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::migrate_step(int n_groups) {
+  int end = std::min(old_table_.capacity(), migrate_pos_ + n_groups * Group::kWidth);
+
+  for (int group_start = migrate_pos_; group_start < end; group_start += Group::kWidth) {
+    internal::BitMask full = Group(&old_table_.ctrl[group_start]).match_full();
+
+    for (; full.any(); full.clear_lowest()) {
+      int old_idx = group_start + full.lowest();
+      Slot& old_slot = slot(old_table_, old_idx);
+
+      int idx = claim_slot(table_, hash_of(old_slot.key));
+      new (&table_.data[idx]) Slot(std::move(old_slot));
+
+      // the moved slot becomes a tombstone, so the probe sequences of the
+      // keys that are still in the old table keep going through it
+      old_slot.~Slot();
+      old_table_.ctrl[old_idx] = internal::kDeleted;
+      old_table_.deleted_slots++;
     }
   }
+
+  migrate_pos_ = end;
+
+  if (migrate_pos_ == old_table_.capacity()) {
+    std::vector<ctrl_t>().swap(old_table_.ctrl);
+    old_table_.data.reset();
+    old_table_.used_slots = 0;
+    old_table_.deleted_slots = 0;
+    migrate_pos_ = 0;
+  }
 }
 
-template<typename K, typename V, typename H>
-V& HashMap<K, V, H>::operator[](const K& key) {
-  int idx = find_index(key);
-  
-  if (data_[idx].state != Slot::State::USED){
-    // we have to initialize the pointer with something
-    // could be a deleted key or just unused
-    
-    V default_val = V();
-    set(key, default_val);
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::complete_migration() {
+  if (migrating()) {
+    migrate_step(old_table_.capacity() / Group::kWidth);
   }
-  
-  return get(key);
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+double HashMap<K, V, H, E, P>::loadFactor(const Table& table) {
+  return static_cast<double>(table.used_slots) / table.capacity();
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::destroy_slots(Table& table){
+  for (int group_start = 0; group_start < table.capacity(); group_start += Group::kWidth) {
+    internal::BitMask full = Group(&table.ctrl[group_start]).match_full();
+    for (; full.any(); full.clear_lowest()) {
+      slot(table, group_start + full.lowest()).~Slot();
+    }
+  }
+
+  table.ctrl.assign(table.ctrl.size(), internal::kEmpty);
+  table.used_slots = 0;
+  table.deleted_slots = 0;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void HashMap<K, V, H, E, P>::clear(){
+  destroy_slots(table_);
+
+  if (migrating()) {
+    destroy_slots(old_table_);
+    std::vector<ctrl_t>().swap(old_table_.ctrl);
+    old_table_.data.reset();
+    migrate_pos_ = 0;
+  }
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+HashMap<K, V, H, E, P>::~HashMap(){
+  clear();
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+V& HashMap<K, V, H, E, P>::operator[](const K& key) {
+  // the value is value initialised in place when the key is absent
+  return find_or_insert(hash_of(key), key).first->val;
 }
 
 // the operator[] can be called with const requiring that the key is inserted
-template<typename K, typename V, typename H>
-V& HashMap<K, V, H>::operator[](const K& key) const{
-  int idx = find_index(key);
-  
+template<typename K, typename V, typename H, typename E, typename P>
+V& HashMap<K, V, H, E, P>::operator[](const K& key) const{
   return get(key);
 }
 
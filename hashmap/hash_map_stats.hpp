@@ -0,0 +1,151 @@
+#ifndef HASHMAP_HASH_MAP_STATS_H_
+#define HASHMAP_HASH_MAP_STATS_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+namespace dicts {
+
+// Statistics of a HashMap, only collected when DICTS_HASHMAP_STATS is
+// defined before hash_map.hpp is included. Otherwise HashMap keeps no
+// counters and stats() returns a snapshot with enabled set to false.
+//
+// A probe length counts the groups visited with GroupProbing and the slots
+// visited with RobinHoodProbing, lookups that end in the home group or slot
+// have length 1.
+struct HashMapStats {
+    static const int kProbeBuckets = 16;
+
+    bool enabled;
+
+    // probe_histogram[i] counts the probes of length i + 1, the last bucket
+    // also counts the longer ones
+    uint64_t probe_histogram[kProbeBuckets];
+
+    // lookups made by find, get, set, operator[] and their variants
+    uint64_t hits;
+    uint64_t misses;
+
+    // reorder() calls, during an incremental resize only the start of the
+    // resize is timed and not the migration spread over later operations
+    uint64_t reorders;
+    uint64_t reorder_total_ns;
+    uint64_t reorder_max_ns;
+
+    // tombstone clean ups that did not grow the table
+    uint64_t in_place_rehashes;
+
+    int tombstones;
+    double load_factor;
+    double peak_load_factor;
+
+    HashMapStats(): enabled(false), hits(0), misses(0), reorders(0), reorder_total_ns(0),
+                    reorder_max_ns(0), in_place_rehashes(0), tombstones(0), load_factor(0),
+                    peak_load_factor(0) {
+      std::fill(probe_histogram, probe_histogram + kProbeBuckets, 0);
+    }
+
+    // adds the counters of other, e.g. to sum the shards of a map
+    void merge(const HashMapStats& other) {
+      enabled = enabled or other.enabled;
+      for (int i = 0; i < kProbeBuckets; i++) {
+        probe_histogram[i] += other.probe_histogram[i];
+      }
+      hits += other.hits;
+      misses += other.misses;
+      reorders += other.reorders;
+      reorder_total_ns += other.reorder_total_ns;
+      reorder_max_ns = std::max(reorder_max_ns, other.reorder_max_ns);
+      in_place_rehashes += other.in_place_rehashes;
+      tombstones += other.tombstones;
+      peak_load_factor = std::max(peak_load_factor, other.peak_load_factor);
+    }
+};
+
+inline std::ostream& operator<< (std::ostream& os, const HashMapStats& stats) {
+  if (!stats.enabled) {
+    return os << "hash map stats disabled, build with DICTS_HASHMAP_STATS" << std::endl;
+  }
+
+  uint64_t probes = 0;
+  for (int i = 0; i < HashMapStats::kProbeBuckets; i++) {
+    probes += stats.probe_histogram[i];
+  }
+
+  os << "lookups: " << stats.hits << " hits, " << stats.misses << " misses" << std::endl;
+  os << "probe lengths:" << std::endl;
+  for (int i = 0; i < HashMapStats::kProbeBuckets; i++) {
+    if (stats.probe_histogram[i] == 0) {
+      continue;
+    }
+    os << "  " << (i + 1) << (i + 1 == HashMapStats::kProbeBuckets ? "+" : "") << ": "
+       << stats.probe_histogram[i] << " (" << 100.0 * stats.probe_histogram[i] / probes << "%)" << std::endl;
+  }
+  os << "reorders: " << stats.reorders << ", " << stats.reorder_total_ns / 1000 << " us total, "
+     << stats.reorder_max_ns / 1000 << " us max" << std::endl;
+  os << "in place rehashes: " << stats.in_place_rehashes << std::endl;
+  os << "tombstones: " << stats.tombstones << std::endl;
+  os << "load factor: " << stats.load_factor << ", peak " << stats.peak_load_factor << std::endl;
+
+  return os;
+}
+
+namespace internal {
+
+// Counters behind HashMapStats. Lookups are const and may run concurrently
+// under a shared lock, so their counters are relaxed atomics, the rest is
+// only written by the single writer.
+struct StatsCounters {
+    std::atomic<uint64_t> probe_histogram[HashMapStats::kProbeBuckets];
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+
+    uint64_t reorders;
+    uint64_t reorder_total_ns;
+    uint64_t reorder_max_ns;
+    uint64_t in_place_rehashes;
+    double peak_load_factor;
+
+    StatsCounters(): hits(0), misses(0), reorders(0), reorder_total_ns(0), reorder_max_ns(0),
+                     in_place_rehashes(0), peak_load_factor(0) {
+      for (int i = 0; i < HashMapStats::kProbeBuckets; i++) {
+        probe_histogram[i].store(0, std::memory_order_relaxed);
+      }
+    }
+
+    void record_probe(int length) {
+      int bucket = std::min(length, static_cast<int>(HashMapStats::kProbeBuckets)) - 1;
+      probe_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void record_lookup(bool hit) {
+      (hit ? hits : misses).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void record_reorder(uint64_t ns) {
+      reorders++;
+      reorder_total_ns += ns;
+      reorder_max_ns = std::max(reorder_max_ns, ns);
+    }
+
+    void fill(HashMapStats* stats) const {
+      stats->enabled = true;
+      for (int i = 0; i < HashMapStats::kProbeBuckets; i++) {
+        stats->probe_histogram[i] = probe_histogram[i].load(std::memory_order_relaxed);
+      }
+      stats->hits = hits.load(std::memory_order_relaxed);
+      stats->misses = misses.load(std::memory_order_relaxed);
+      stats->reorders = reorders;
+      stats->reorder_total_ns = reorder_total_ns;
+      stats->reorder_max_ns = reorder_max_ns;
+      stats->in_place_rehashes = in_place_rehashes;
+      stats->peak_load_factor = peak_load_factor;
+    }
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef HASHMAP_HASH_MIX_H_
+#define HASHMAP_HASH_MIX_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dicts {
+namespace internal {
+
+const uint64_t kHashSeed = 0xa0761d6478bd642fULL;
+
+// Finalizer applied on top of the user hash. std::hash<int> is the identity
+// on libstdc++, and with a power of two table only the low bits would pick
+// the group, so patterned keys would land in the same few groups. The mix
+// spreads every input bit over the whole word (wyhash's multiply and fold
+// when 128 bit products are available, murmur3's fmix64 otherwise).
+inline uint64_t mix_hash(uint64_t h) {
+#if defined(__SIZEOF_INT128__)
+  __uint128_t product = static_cast<__uint128_t>(h ^ kHashSeed) * 0xe7037ed1a0b428dbULL;
+  return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+#else
+  h ^= kHashSeed;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+#endif
+}
+
+}
+}
+
+#endif
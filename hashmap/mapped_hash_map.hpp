@@ -0,0 +1,400 @@
+#ifndef HASHMAP_MAPPED_HASH_MAP_H_
+#define HASHMAP_MAPPED_HASH_MAP_H_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash_map.hpp"
+
+namespace dicts {
+
+namespace internal {
+
+// Layout of a snapshot file: this header, the control bytes at ctrl_offset
+// and the slot array at slots_offset, both exactly as HashMap keeps them in
+// memory. Offsets are from the start of the file, so the file works at any
+// address it is mapped at.
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t probing;
+
+    // checked on open, a snapshot is only read back by a build with the
+    // same key/value types, group width and hash seed
+    uint32_t key_size;
+    uint32_t value_size;
+    uint32_t slot_size;
+    uint32_t slot_align;
+    uint32_t group_width;
+    uint32_t reserved;
+    uint64_t hash_seed;
+
+    uint64_t capacity;
+    uint64_t size;
+    uint64_t deleted_slots;
+    uint64_t ctrl_offset;
+    uint64_t slots_offset;
+};
+
+const char kSnapshotMagic[8] = {'D', 'I', 'C', 'T', 'S', 'H', 'M', '\0'};
+
+const uint32_t kSnapshotVersion = 1;
+
+// the slot array starts on a cache line
+const uint64_t kSnapshotAlign = 64;
+
+inline uint32_t probing_id(GroupProbing) { return 0; }
+
+inline uint32_t probing_id(RobinHoodProbing) { return 1; }
+
+}
+
+// Read-only HashMap backed by a snapshot file mapped with mmap. A snapshot
+// is the slot array of a HashMap written as is, so opening one does not
+// hash or copy anything: lookups run the HashMap probing code directly over
+// the mapping and the slot pages are faulted in as they are touched. Only
+// the control bytes, one per slot, are read on open to check them.
+//
+// Only maps of trivially copyable keys and values can be saved, and the
+// hash function must give the same values in every process (std::hash of
+// integers does, a per-process random seed would not).
+template<typename K, typename V, typename H = std::hash<K>, typename E = std::equal_to<K>,
+         typename P = GroupProbing>
+class MappedHashMap {
+  public:
+    MappedHashMap();
+
+    MappedHashMap(const MappedHashMap&) = delete;
+
+    MappedHashMap& operator=(const MappedHashMap&) = delete;
+
+    ~MappedHashMap();
+
+    // Writes the table of hm to path, a pending incremental resize of hm is
+    // completed first. Returns false when the file cannot be written.
+    static bool save(HashMap<K, V, H, E, P>& hm, const std::string& path);
+
+    // Maps the snapshot at path, replacing the one open before. Returns
+    // false when the file cannot be mapped, was not written by a compatible
+    // build or is corrupt.
+    bool open(const std::string& path);
+
+    void close();
+
+    bool is_open() const;
+
+    int size() const;
+
+    // Returns a pointer into the mapping, or nullptr when key is absent.
+    const V* find(const K& key) const;
+
+    const V& get(const K& key) const;
+
+    // Copies the mapped table into a HashMap that can be modified. The
+    // slots are copied in bulk and keep their positions, nothing is rehashed.
+    HashMap<K, V, H, E, P> load() const;
+
+    // Lookup statistics of this map, see HashMap::stats.
+    HashMapStats stats() const;
+
+  private:
+    typedef HashMap<K, V, H, E, P> Map;
+    typedef typename Map::Slot Slot;
+    typedef typename Map::SlotStorage SlotStorage;
+
+    // a Table that points into the mapping instead of owning its arrays
+    struct MappedTable {
+        const internal::ctrl_t* ctrl;
+        SlotStorage* data;
+        int n_slots;
+        int deleted_slots;
+
+        int capacity() const { return n_slots; }
+    };
+
+    static bool valid(const internal::SnapshotHeader& header, size_t file_size);
+
+    bool valid_ctrl(const internal::SnapshotHeader& header, const internal::ctrl_t* ctrl) const;
+
+    // only used for its hash and equality functions and its lookups, its
+    // own table stays empty
+    Map map_;
+
+    void* mapping_;
+    size_t mapping_size_;
+
+    MappedTable table_;
+    int size_;
+};
+
+
+template<typename K, typename V, typename H, typename E, typename P>
+MappedHashMap<K, V, H, E, P>::MappedHashMap():
+                mapping_(nullptr),
+                mapping_size_(0),
+                size_(0)
+{
+  table_.ctrl = nullptr;
+  table_.data = nullptr;
+  table_.n_slots = 0;
+  table_.deleted_slots = 0;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+MappedHashMap<K, V, H, E, P>::~MappedHashMap() {
+  close();
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+bool MappedHashMap<K, V, H, E, P>::save(HashMap<K, V, H, E, P>& hm, const std::string& path) {
+  static_assert(std::is_trivially_copyable<K>::value and std::is_trivially_copyable<V>::value,
+                "only maps of trivially copyable keys and values can be saved");
+
+  hm.complete_migration();
+  const typename Map::Table& table = hm.table_;
+
+  internal::SnapshotHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, internal::kSnapshotMagic, sizeof(header.magic));
+  header.version = internal::kSnapshotVersion;
+  header.probing = internal::probing_id(P());
+  header.key_size = sizeof(K);
+  header.value_size = sizeof(V);
+  header.slot_size = sizeof(Slot);
+  header.slot_align = alignof(Slot);
+  header.group_width = internal::Group::kWidth;
+  header.hash_seed = internal::kHashSeed;
+  header.capacity = static_cast<uint64_t>(table.capacity());
+  header.size = static_cast<uint64_t>(hm.size());
+  header.deleted_slots = static_cast<uint64_t>(table.deleted_slots);
+  header.ctrl_offset = sizeof(header);
+
+  uint64_t ctrl_end = header.ctrl_offset + header.capacity;
+  header.slots_offset = (ctrl_end + internal::kSnapshotAlign - 1) / internal::kSnapshotAlign *
+                        internal::kSnapshotAlign;
+
+  std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(&table.ctrl[0]), table.capacity());
+
+  std::vector<char> padding(header.slots_offset - ctrl_end, 0);
+  out.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+
+  // a group of slots at a time, the slots that are not full are written as
+  // zeros rather than as whatever their memory held
+  std::vector<SlotStorage> group(internal::Group::kWidth);
+  for (int group_start = 0; group_start < table.capacity(); group_start += internal::Group::kWidth) {
+    std::memset(static_cast<void*>(group.data()), 0, group.size() * sizeof(SlotStorage));
+
+    internal::BitMask full = internal::Group(&table.ctrl[group_start]).match_full();
+    for (; full.any(); full.clear_lowest()) {
+      std::memcpy(&group[full.lowest()], &table.data[group_start + full.lowest()], sizeof(Slot));
+    }
+    out.write(reinterpret_cast<const char*>(group.data()),
+              static_cast<std::streamsize>(group.size() * sizeof(SlotStorage)));
+  }
+
+  out.close();
+  return !out.fail();
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+bool MappedHashMap<K, V, H, E, P>::valid(const internal::SnapshotHeader& header, size_t file_size) {
+  if (std::memcmp(header.magic, internal::kSnapshotMagic, sizeof(header.magic)) != 0 or
+      header.version != internal::kSnapshotVersion or
+      header.probing != internal::probing_id(P()) or
+      header.key_size != sizeof(K) or header.value_size != sizeof(V) or
+      header.slot_size != sizeof(Slot) or header.slot_align != alignof(Slot) or
+      header.hash_seed != internal::kHashSeed) {
+    return false;
+  }
+
+  // the group probe sequence depends on the group width, Robin Hood
+  // positions do not
+  if (header.probing == internal::probing_id(GroupProbing()) and
+      header.group_width != static_cast<uint32_t>(internal::Group::kWidth)) {
+    return false;
+  }
+
+  // a power of two number of whole groups, as HashMap::init_table makes them
+  uint64_t capacity = header.capacity;
+  if (capacity < static_cast<uint64_t>(internal::Group::kWidth) or (capacity & (capacity - 1)) != 0 or
+      capacity > static_cast<uint64_t>(INT32_MAX) or header.size > capacity) {
+    return false;
+  }
+
+  // the offsets come from the file, they are checked against its size
+  // before anything is added to them so that a huge one cannot wrap around.
+  // capacity * sizeof(SlotStorage) cannot overflow, capacity fits in 31 bits
+  return header.ctrl_offset >= sizeof(header) and
+         header.ctrl_offset <= file_size and capacity <= file_size - header.ctrl_offset and
+         header.ctrl_offset + capacity <= header.slots_offset and
+         header.slots_offset % internal::kSnapshotAlign == 0 and
+         header.slots_offset <= file_size and
+         capacity * sizeof(SlotStorage) <= file_size - header.slots_offset;
+}
+
+// Lookups and load() trust the control bytes, so they are counted once:
+// every byte must be a known state, the counts must match the header, an
+// empty slot must be left to end the probes, and the table must be within
+// the load bound of the HashMap that load() returns.
+template<typename K, typename V, typename H, typename E, typename P>
+bool MappedHashMap<K, V, H, E, P>::valid_ctrl(const internal::SnapshotHeader& header,
+                                              const internal::ctrl_t* ctrl) const {
+  uint64_t full = 0;
+  uint64_t deleted = 0;
+  uint64_t empty = 0;
+  for (uint64_t i = 0; i < header.capacity; i++) {
+    if (internal::is_full(ctrl[i])) {
+      full++;
+    } else if (ctrl[i] == internal::kDeleted) {
+      deleted++;
+    } else if (ctrl[i] == internal::kEmpty) {
+      empty++;
+    } else {
+      return false;
+    }
+  }
+
+  return full == header.size and deleted == header.deleted_slots and empty > 0 and
+         static_cast<double>(full + deleted) / header.capacity <= map_.kLoadFactorBound;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+bool MappedHashMap<K, V, H, E, P>::open(const std::string& path) {
+  static_assert(std::is_trivially_copyable<K>::value and std::is_trivially_copyable<V>::value,
+                "only maps of trivially copyable keys and values can be mapped");
+
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 or static_cast<size_t>(st.st_size) < sizeof(internal::SnapshotHeader)) {
+    ::close(fd);
+    return false;
+  }
+
+  size_t file_size = static_cast<size_t>(st.st_size);
+  void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+
+  const internal::SnapshotHeader& header = *static_cast<const internal::SnapshotHeader*>(mapping);
+  char* base = static_cast<char*>(mapping);
+  if (!valid(header, file_size) or
+      !valid_ctrl(header, reinterpret_cast<const internal::ctrl_t*>(base + header.ctrl_offset))) {
+    munmap(mapping, file_size);
+    return false;
+  }
+
+  // the mapping is read only, lookups never write through data
+  mapping_ = mapping;
+  mapping_size_ = file_size;
+  table_.ctrl = reinterpret_cast<const internal::ctrl_t*>(base + header.ctrl_offset);
+  table_.data = reinterpret_cast<SlotStorage*>(base + header.slots_offset);
+  table_.n_slots = static_cast<int>(header.capacity);
+  table_.deleted_slots = static_cast<int>(header.deleted_slots);
+  size_ = static_cast<int>(header.size);
+
+  return true;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+void MappedHashMap<K, V, H, E, P>::close() {
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+  }
+
+  mapping_ = nullptr;
+  mapping_size_ = 0;
+  table_.ctrl = nullptr;
+  table_.data = nullptr;
+  table_.n_slots = 0;
+  table_.deleted_slots = 0;
+  size_ = 0;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+bool MappedHashMap<K, V, H, E, P>::is_open() const {
+  return mapping_ != nullptr;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+int MappedHashMap<K, V, H, E, P>::size() const {
+  return size_;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+const V* MappedHashMap<K, V, H, E, P>::find(const K& key) const {
+  if (!is_open()) {
+    return nullptr;
+  }
+
+  int idx = map_.find_index(table_, key, map_.hash_of(key));
+  map_.record_lookup(idx >= 0);
+
+  return idx >= 0 ? &Map::slot(table_, idx).val : nullptr;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+const V& MappedHashMap<K, V, H, E, P>::get(const K& key) const {
+  const V* found = find(key);
+  assert(found != nullptr);
+  return *found;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+HashMap<K, V, H, E, P> MappedHashMap<K, V, H, E, P>::load() const {
+  Map hm;
+  if (!is_open()) {
+    return hm;
+  }
+
+  typename Map::Table& table = hm.table_;
+  Map::init_table(table, table_.capacity());
+
+  // init_table rounds up to whole groups, which a mapped capacity already is
+  assert(table.capacity() == table_.capacity());
+
+  std::memcpy(&table.ctrl[0], table_.ctrl, static_cast<size_t>(table_.capacity()));
+  std::memcpy(static_cast<void*>(table.data.get()), table_.data,
+              static_cast<size_t>(table_.capacity()) * sizeof(SlotStorage));
+  table.used_slots = size_ + table_.deleted_slots;
+  table.deleted_slots = table_.deleted_slots;
+
+  return hm;
+}
+
+template<typename K, typename V, typename H, typename E, typename P>
+HashMapStats MappedHashMap<K, V, H, E, P>::stats() const {
+  HashMapStats stats = map_.stats();
+
+  if (stats.enabled and is_open()) {
+    stats.tombstones = table_.deleted_slots;
+    stats.load_factor = static_cast<double>(size_) / table_.capacity();
+  }
+
+  return stats;
+}
+
+}
+
+#endif
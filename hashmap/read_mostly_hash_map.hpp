@@ -0,0 +1,333 @@
+#ifndef HASHMAP_READ_MOSTLY_HASH_MAP_H_
+#define HASHMAP_READ_MOSTLY_HASH_MAP_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "epoch.hpp"
+#include "hash_mix.hpp"
+
+namespace dicts {
+
+// HashMap for read mostly data, e.g. configuration tables. Readers never
+// take a lock: they pin an epoch (see epoch.hpp), load the table with
+// acquire loads and copy the value out. Writers are serialised by a mutex,
+// they publish immutable entries into the slots with release stores and a
+// resize builds a whole new table that is published with a single pointer
+// store. Replaced entries and old tables are freed once no reader can
+// still see them.
+//
+// Slots are probed linearly and the load factor is kept under 1/2, there is
+// no control byte array because readers would race with the writer on it.
+// Instead a slot packs the entry pointer with the top 16 bits of its hash,
+// so probing only follows the pointers whose tag matches. This assumes that
+// user space pointers fit in 48 bits, as on x86-64 with 4 level paging and
+// on AArch64 with 48 bit addresses. Linux with 5 level paging (LA57) only
+// maps above that on request, but other ABIs may not, and pack() asserts
+// it. On 32 bit targets the tag is empty.
+template<typename K, typename V, typename H = std::hash<K>, typename E = std::equal_to<K> >
+class ReadMostlyHashMap {
+  public:
+    ReadMostlyHashMap();
+
+    ReadMostlyHashMap(const ReadMostlyHashMap&) = delete;
+
+    ReadMostlyHashMap& operator=(const ReadMostlyHashMap&) = delete;
+
+    ~ReadMostlyHashMap();
+
+    // Values are copied out, an entry can be freed once the read is over.
+    V get(const K& key) const;
+
+    bool find(const K& key, V* val) const;
+
+    bool exists(const K& key) const;
+
+    void set(const K& key, const V& val);
+
+    void erase(const K& key);
+
+  private:
+    struct Entry {
+        const K key;
+        const V val;
+        const size_t hash;
+
+        Entry(const K& k, const V& v, size_t h): key(k), val(v), hash(h) {}
+    };
+
+    struct Table {
+        const int capacity;
+
+        // kEmptySlot, kTombstone or a tagged Entry pointer
+        std::unique_ptr<std::atomic<uintptr_t>[]> slots;
+
+        // only read and written by the writer
+        int used_slots;
+        int deleted_slots;
+
+        explicit Table(int n_slots);
+    };
+
+    static uintptr_t tag_of(size_t hash);
+
+    static uintptr_t pack(Entry* entry);
+
+    static Entry* entry_of(uintptr_t slot);
+
+    size_t hash_of(const K& key) const;
+
+    const Entry* find_entry(const Table& table, const K& key, size_t hash) const;
+
+    int find_index(const Table& table, const K& key, size_t hash) const;
+
+    static int find_free_index(const Table& table, size_t hash);
+
+    void rebuild(int live_entries);
+
+    static const int kInitDataSize = 16;
+
+    static const uintptr_t kEmptySlot = 0;
+
+    static const uintptr_t kTombstone = 1;
+
+    static const uintptr_t kPointerMask = static_cast<uintptr_t>((static_cast<uint64_t>(1) << 48) - 1);
+
+    const H hash_fn_;
+
+    const E eq_fn_;
+
+    std::atomic<Table*> table_;
+
+    mutable EpochManager epoch_;
+
+    std::mutex writer_mutex_;
+};
+
+
+template<typename K, typename V, typename H, typename E>
+ReadMostlyHashMap<K, V, H, E>::Table::Table(int n_slots):
+                capacity(n_slots),
+                slots(new std::atomic<uintptr_t>[n_slots]),
+                used_slots(0),
+                deleted_slots(0)
+{
+  for (int i = 0; i < capacity; i++) {
+    slots[i].store(kEmptySlot, std::memory_order_relaxed);
+  }
+}
+
+template<typename K, typename V, typename H, typename E>
+ReadMostlyHashMap<K, V, H, E>::ReadMostlyHashMap():
+                hash_fn_(H()),
+                eq_fn_(E()),
+                table_(new Table(kInitDataSize))
+{
+}
+
+template<typename K, typename V, typename H, typename E>
+ReadMostlyHashMap<K, V, H, E>::~ReadMostlyHashMap() {
+  Table* table = table_.load();
+
+  for (int i = 0; i < table->capacity; i++) {
+    uintptr_t slot = table->slots[i].load(std::memory_order_relaxed);
+    if (slot != kEmptySlot and slot != kTombstone) {
+      delete entry_of(slot);
+    }
+  }
+
+  delete table;
+}
+
+template<typename K, typename V, typename H, typename E>
+uintptr_t ReadMostlyHashMap<K, V, H, E>::tag_of(size_t hash) {
+  return static_cast<uintptr_t>(static_cast<uint64_t>(hash) >> 48 << 48);
+}
+
+template<typename K, typename V, typename H, typename E>
+uintptr_t ReadMostlyHashMap<K, V, H, E>::pack(Entry* entry) {
+  // the tag would overwrite address bits above the 48th
+  assert((reinterpret_cast<uintptr_t>(entry) & ~kPointerMask) == 0);
+  return reinterpret_cast<uintptr_t>(entry) | tag_of(entry->hash);
+}
+
+template<typename K, typename V, typename H, typename E>
+typename ReadMostlyHashMap<K, V, H, E>::Entry* ReadMostlyHashMap<K, V, H, E>::entry_of(uintptr_t slot) {
+  return reinterpret_cast<Entry*>(slot & kPointerMask);
+}
+
+template<typename K, typename V, typename H, typename E>
+size_t ReadMostlyHashMap<K, V, H, E>::hash_of(const K& key) const {
+  return static_cast<size_t>(internal::mix_hash(hash_fn_(key)));
+}
+
+template<typename K, typename V, typename H, typename E>
+const typename ReadMostlyHashMap<K, V, H, E>::Entry*
+ReadMostlyHashMap<K, V, H, E>::find_entry(const Table& table, const K& key, size_t hash) const {
+  int mask = table.capacity - 1;
+  uintptr_t tag = tag_of(hash);
+
+  for (int idx = static_cast<int>(hash) & mask; ; idx = (idx + 1) & mask) {
+    uintptr_t slot = table.slots[idx].load(std::memory_order_acquire);
+
+    if (slot == kEmptySlot) {
+      return nullptr;
+    }
+    if (slot != kTombstone and (slot & ~kPointerMask) == tag) {
+      const Entry* entry = entry_of(slot);
+      if (entry->hash == hash and eq_fn_(entry->key, key)) {
+        return entry;
+      }
+    }
+  }
+}
+
+template<typename K, typename V, typename H, typename E>
+int ReadMostlyHashMap<K, V, H, E>::find_index(const Table& table, const K& key, size_t hash) const {
+  int mask = table.capacity - 1;
+  uintptr_t tag = tag_of(hash);
+
+  for (int idx = static_cast<int>(hash) & mask; ; idx = (idx + 1) & mask) {
+    uintptr_t slot = table.slots[idx].load(std::memory_order_relaxed);
+
+    if (slot == kEmptySlot) {
+      return -1;
+    }
+    if (slot != kTombstone and (slot & ~kPointerMask) == tag) {
+      const Entry* entry = entry_of(slot);
+      if (entry->hash == hash and eq_fn_(entry->key, key)) {
+        return idx;
+      }
+    }
+  }
+}
+
+template<typename K, typename V, typename H, typename E>
+int ReadMostlyHashMap<K, V, H, E>::find_free_index(const Table& table, size_t hash) {
+  int mask = table.capacity - 1;
+
+  for (int idx = static_cast<int>(hash) & mask; ; idx = (idx + 1) & mask) {
+    uintptr_t slot = table.slots[idx].load(std::memory_order_relaxed);
+
+    if (slot == kEmptySlot or slot == kTombstone) {
+      return idx;
+    }
+  }
+}
+
+template<typename K, typename V, typename H, typename E>
+V ReadMostlyHashMap<K, V, H, E>::get(const K& key) const {
+  V val;
+  bool found = find(key, &val);
+  assert(found);
+  (void) found;
+  return val;
+}
+
+template<typename K, typename V, typename H, typename E>
+bool ReadMostlyHashMap<K, V, H, E>::find(const K& key, V* val) const {
+  size_t hash = hash_of(key);
+
+  EpochManager::Guard guard = epoch_.pin();
+  const Entry* entry = find_entry(*table_.load(std::memory_order_acquire), key, hash);
+
+  if (entry == nullptr) {
+    return false;
+  }
+
+  *val = entry->val;
+  return true;
+}
+
+template<typename K, typename V, typename H, typename E>
+bool ReadMostlyHashMap<K, V, H, E>::exists(const K& key) const {
+  size_t hash = hash_of(key);
+
+  EpochManager::Guard guard = epoch_.pin();
+  return find_entry(*table_.load(std::memory_order_acquire), key, hash) != nullptr;
+}
+
+template<typename K, typename V, typename H, typename E>
+void ReadMostlyHashMap<K, V, H, E>::set(const K& key, const V& val) {
+  std::lock_guard<std::mutex> guard(writer_mutex_);
+
+  size_t hash = hash_of(key);
+  Entry* entry = new Entry(key, val, hash);
+  Table* table = table_.load(std::memory_order_relaxed);
+  int idx = find_index(*table, key, hash);
+
+  if (idx >= 0) {
+    // the entry is replaced as a whole, readers see either value
+    Entry* old_entry = entry_of(table->slots[idx].load(std::memory_order_relaxed));
+    table->slots[idx].store(pack(entry), std::memory_order_release);
+    epoch_.retire(old_entry);
+  } else {
+    if ((table->used_slots + 1) * 2 > table->capacity) {
+      rebuild(table->used_slots - table->deleted_slots + 1);
+      table = table_.load(std::memory_order_relaxed);
+    }
+
+    idx = find_free_index(*table, hash);
+    if (table->slots[idx].load(std::memory_order_relaxed) == kTombstone) {
+      table->deleted_slots--;
+    } else {
+      table->used_slots++;
+    }
+    table->slots[idx].store(pack(entry), std::memory_order_release);
+  }
+
+  epoch_.try_reclaim();
+}
+
+template<typename K, typename V, typename H, typename E>
+void ReadMostlyHashMap<K, V, H, E>::erase(const K& key) {
+  std::lock_guard<std::mutex> guard(writer_mutex_);
+
+  Table* table = table_.load(std::memory_order_relaxed);
+  int idx = find_index(*table, key, hash_of(key));
+
+  if (idx < 0) {
+    return;
+  }
+
+  Entry* old_entry = entry_of(table->slots[idx].load(std::memory_order_relaxed));
+  table->slots[idx].store(kTombstone, std::memory_order_release);
+  table->deleted_slots++;
+  epoch_.retire(old_entry);
+
+  epoch_.try_reclaim();
+}
+
+template<typename K, typename V, typename H, typename E>
+void ReadMostlyHashMap<K, V, H, E>::rebuild(int live_entries) {
+  // sized for a load factor of 1/4, it also drops the tombstones
+  int n_slots = kInitDataSize;
+  while (n_slots < live_entries * 4) {
+    n_slots *= 2;
+  }
+
+  Table* old_table = table_.load(std::memory_order_relaxed);
+  Table* new_table = new Table(n_slots);
+
+  // the entries are shared by both tables, only the slot array is new
+  for (int i = 0; i < old_table->capacity; i++) {
+    uintptr_t slot = old_table->slots[i].load(std::memory_order_relaxed);
+    if (slot != kEmptySlot and slot != kTombstone) {
+      int idx = find_free_index(*new_table, entry_of(slot)->hash);
+      new_table->slots[idx].store(slot, std::memory_order_relaxed);
+      new_table->used_slots++;
+    }
+  }
+
+  table_.store(new_table, std::memory_order_release);
+  epoch_.retire(old_table);
+}
+
+}
+
+#endif
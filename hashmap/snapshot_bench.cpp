@@ -0,0 +1,69 @@
+#include "mapped_hash_map.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Compares rebuilding a map with set() against opening a snapshot of it,
+// both followed by the same random lookups.
+//
+// usage: snapshot_bench [entries] [snapshot path]
+
+int main(int argc, char* argv[]) {
+  int n_entries = argc > 1 ? std::atoi(argv[1]) : 8000000;
+  const char* path = argc > 2 ? argv[2] : "hash_map.snapshot";
+  const int n_lookups = 1000000;
+
+  std::mt19937_64 rng(42);
+  std::vector<int64_t> keys(n_lookups);
+  for (auto& key : keys) {
+    key = rng() % n_entries;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  dicts::HashMap<int64_t, int64_t> hm;
+  for (int i = 0; i < n_entries; i++) {
+    hm.set(i, i);
+  }
+  double build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  if (!dicts::MappedHashMap<int64_t, int64_t>::save(hm, path)) {
+    std::cerr << "cannot write " << path << std::endl;
+    return 1;
+  }
+
+  start = std::chrono::steady_clock::now();
+  dicts::MappedHashMap<int64_t, int64_t> mapped;
+  if (!mapped.open(path)) {
+    std::cerr << "cannot map " << path << std::endl;
+    return 1;
+  }
+  double open_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  int64_t checksum = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < n_lookups; i++) {
+    checksum += mapped.get(keys[i]);
+  }
+  double mapped_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < n_lookups; i++) {
+    checksum -= hm.get(keys[i]);
+  }
+  double owned_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  bool same = checksum == 0 and mapped.size() == hm.size() and mapped.find(-1) == nullptr;
+  std::remove(path);
+
+  std::cout << "entries " << n_entries << std::endl;
+  std::cout << "rebuild with set: " << build_ms << " ms" << std::endl;
+  std::cout << "open snapshot:    " << open_ms << " ms" << std::endl;
+  std::cout << "lookups, mapped:  " << mapped_ms << " ms (first touch faults the pages in)" << std::endl;
+  std::cout << "lookups, owned:   " << owned_ms << " ms" << std::endl;
+
+  return same ? 0 : 1;
+}
@@ -15,7 +15,7 @@ template<typename T>
 T  median_of_medians(std::vector<T> a) {
 	std::vector<std::vector<T> > lists;
 	
-	for (int i = 0; i < a.size(); i+= 5) {
+	for (int i = 0; i < (int) a.size(); i+= 5) {
 		std::vector<T> v;
 		lists.push_back(v);
 		for (int j = i; j < std::min((int) a.size(), i+5); j++) {
@@ -25,7 +25,7 @@ T  median_of_medians(std::vector<T> a) {
 	
 	std::vector<T> medians;
 	
-	for(int i = 0; i < lists.size(); i++) {
+	for(int i = 0; i < (int) lists.size(); i++) {
 		std::sort(lists[i].begin(), lists[i].end());
 		int sz = lists[i].size();
 		medians.push_back(lists[i][(sz - 1) / 2]);
@@ -53,12 +53,12 @@ T select(std::vector<T> a, int r) {
 	
 	//std::cout << r << " "<< small.size() << " " << big.size() << std::endl;
 	
-	if (r == small.size()) {
+	if (r == (int) small.size()) {
 		return x;
-	} else if (r < small.size() ) {
+	} else if (r < (int) small.size() ) {
 		return select<T>(small, r);
 	} else {
-		return select<T>(big, r - small.size() - 1);
+		return select<T>(big, r - (int) small.size() - 1);
 	}
 			
 }
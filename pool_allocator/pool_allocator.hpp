@@ -0,0 +1,224 @@
+#ifndef POOL_ALLOCATOR_POOL_ALLOCATOR_H_
+#define POOL_ALLOCATOR_POOL_ALLOCATOR_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace dicts {
+
+namespace internal {
+
+// Fixed size blocks carved out of chunks that double in size. Freed blocks
+// go on a free list threaded through the blocks themselves and are handed
+// out again first. The chunks are only returned when the pool is destroyed.
+class Pool {
+  public:
+    explicit Pool(size_t block_size): block_size_(round_up(block_size)), next_chunk_blocks_(kFirstChunkBlocks),
+                                      free_list_(nullptr), bump_(nullptr), bump_end_(nullptr) {}
+
+    Pool(const Pool&) = delete;
+
+    Pool& operator=(const Pool&) = delete;
+
+    ~Pool() {
+      for (char* chunk : chunks_) {
+        ::operator delete(chunk);
+      }
+    }
+
+    size_t block_size() const { return block_size_; }
+
+    void* allocate() {
+      if (free_list_ != nullptr) {
+        FreeBlock* block = free_list_;
+        free_list_ = block->next;
+        return block;
+      }
+
+      if (bump_ == bump_end_) {
+        add_chunk();
+      }
+
+      void* block = bump_;
+      bump_ += block_size_;
+      return block;
+    }
+
+    void deallocate(void* ptr) {
+      FreeBlock* block = static_cast<FreeBlock*>(ptr);
+      block->next = free_list_;
+      free_list_ = block;
+    }
+
+  private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    // blocks keep the alignment of max_align_t that ::operator new gives
+    // the chunks, and have room for a free list link
+    static size_t round_up(size_t size) {
+      size_t align = alignof(std::max_align_t);
+      size = std::max(size, sizeof(FreeBlock));
+      return (size + align - 1) / align * align;
+    }
+
+    void add_chunk() {
+      char* chunk = static_cast<char*>(::operator new(next_chunk_blocks_ * block_size_));
+      chunks_.push_back(chunk);
+
+      bump_ = chunk;
+      bump_end_ = chunk + next_chunk_blocks_ * block_size_;
+      if (next_chunk_blocks_ < kMaxChunkBlocks) {
+        next_chunk_blocks_ *= 2;
+      }
+    }
+
+    static const size_t kFirstChunkBlocks = 64;
+
+    static const size_t kMaxChunkBlocks = 64 * 1024;
+
+    const size_t block_size_;
+
+    size_t next_chunk_blocks_;
+
+    std::vector<char*> chunks_;
+
+    FreeBlock* free_list_;
+
+    // unused part of the last chunk
+    char* bump_;
+    char* bump_end_;
+};
+
+}
+
+// Allocator for node based containers, usable as the allocator parameter
+// of AVLDict, SplayDict and BST. Single objects come from a pool of fixed
+// size blocks laid out next to each other in large chunks, so nodes that
+// are allocated together stay close in memory, and the chunks are freed
+// all at once with the last copy of the allocator instead of node by node.
+// Arrays and objects of another size than the first one allocated go to
+// ::operator new.
+//
+// Copies and rebinds of an allocator share its pool. A container that is
+// copied gets a pool of its own (select_on_container_copy_construction).
+// A container only leaves its nodes to the pool when it holds the last
+// reference to it, otherwise it puts them back on the free list.
+// The pool is not thread safe.
+template<typename T>
+class PoolAllocator {
+  public:
+    typedef T value_type;
+
+    // containers may skip deallocating their nodes one by one, the memory
+    // goes away with the pool
+    typedef std::true_type frees_in_bulk;
+
+    PoolAllocator(): pool_(std::make_shared<std::unique_ptr<internal::Pool> >()) {}
+
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>& other): pool_(other.pool_) {}
+
+    T* allocate(size_t n) {
+      internal::Pool* pool = pool_for(n);
+      if (pool == nullptr) {
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+      }
+      return static_cast<T*>(pool->allocate());
+    }
+
+    void deallocate(T* ptr, size_t n) {
+      internal::Pool* pool = pool_for(n);
+      if (pool == nullptr) {
+        ::operator delete(ptr);
+      } else {
+        pool->deallocate(ptr);
+      }
+    }
+
+    // whether no other allocator shares the pool, so that it goes away
+    // with this one
+    bool is_sole_owner() const {
+      return pool_.use_count() == 1;
+    }
+
+    PoolAllocator select_on_container_copy_construction() const {
+      return PoolAllocator();
+    }
+
+    template<typename U>
+    bool operator== (const PoolAllocator<U>& other) const {
+      return pool_ == other.pool_;
+    }
+
+    template<typename U>
+    bool operator!= (const PoolAllocator<U>& other) const {
+      return pool_ != other.pool_;
+    }
+
+  private:
+    template<typename U>
+    friend class PoolAllocator;
+
+    // the pool is created on the first allocation, by then the allocator
+    // has been rebound to the node type
+    internal::Pool* pool_for(size_t n) {
+      if (n != 1 or alignof(T) > alignof(std::max_align_t)) {
+        return nullptr;
+      }
+
+      std::unique_ptr<internal::Pool>& pool = *pool_;
+      if (pool == nullptr) {
+        pool.reset(new internal::Pool(sizeof(T)));
+      }
+
+      return sizeof(T) <= pool->block_size() ? pool.get() : nullptr;
+    }
+
+    std::shared_ptr<std::unique_ptr<internal::Pool> > pool_;
+};
+
+namespace internal {
+
+// Whether the nodes of a container using A can be left to the allocator
+// instead of being deallocated one by one when the container is destroyed.
+template<typename A>
+struct frees_in_bulk {
+  private:
+    template<typename U>
+    static typename U::frees_in_bulk test(int);
+
+    template<typename U>
+    static std::false_type test(...);
+
+  public:
+    static const bool value = decltype(test<A>(0))::value;
+};
+
+template<typename A>
+bool releases_in_bulk(const A& alloc, std::true_type) {
+  return alloc.is_sole_owner();
+}
+
+template<typename A>
+bool releases_in_bulk(const A&, std::false_type) {
+  return false;
+}
+
+// Whether the nodes allocated with alloc are freed along with it, i.e. it
+// frees in bulk and no other allocator or container shares its memory.
+// Otherwise they have to be deallocated one by one to be reused.
+template<typename A>
+bool releases_in_bulk(const A& alloc) {
+  return releases_in_bulk(alloc, std::integral_constant<bool, frees_in_bulk<A>::value>());
+}
+
+}
+}
+
+#endif
@@ -1,13 +1,20 @@
 #ifndef SPLAY_TREE_H_
 #define SPLAY_TREE_H_
 
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
 #include <utility>  
 #include <iostream>  
 #include <stack>  
+#include <vector>
+
+#include "../pool_allocator/pool_allocator.hpp"
 
 namespace dicts {
 
-template<typename K, typename V> 
+template<typename K, typename V, typename A = std::allocator<std::pair<const K, V> > >
 class SplayDict {
   private:
     struct Node; //Forward declaration
@@ -50,10 +57,25 @@ class SplayDict {
     
     SplayDict();
     
+    // nodes are allocated with alloc, e.g. a PoolAllocator
+    explicit SplayDict(const A& alloc);
+    
     SplayDict(const SplayDict& bst);
     
+    // takes the nodes of bst, which is left empty
+    SplayDict(SplayDict&& bst);
+    
     ~SplayDict();
     
+    // Builds a balanced tree out of the (key, value) pairs in [first, last),
+    // whose keys must be strictly increasing, in O(n). The nodes are
+    // allocated in key order, so that they end up next to each other.
+    template<typename ForwardIt>
+    static SplayDict from_sorted(ForwardIt first, ForwardIt last, const A& alloc = A());
+    
+    template<typename Range>
+    static SplayDict from_sorted(const Range& range, const A& alloc = A());
+    
     bool exists(const K& key) const;
     
     V& get(const K& key);
@@ -68,6 +90,21 @@ class SplayDict {
     
     ConstIterator end();
     
+    // first entry whose key is not below key, or end()
+    ConstIterator lower_bound(const K& key);
+    
+    // first entry whose key is above key, or end()
+    ConstIterator upper_bound(const K& key);
+    
+    std::pair<ConstIterator, ConstIterator> equal_range(const K& key);
+    
+    // Calls fn(key, val) on the entries with lo <= key < hi in key order
+    // until fn returns false. The first entry is splayed to the root, as
+    // in get(), in O(log n) amortized; the k entries after it are streamed
+    // off a stack in O(h + k) for the height h of the root's right subtree.
+    template<typename F>
+    void for_each_in_range(const K& lo, const K& hi, F fn);
+    
 
   private: 
     struct Node {
@@ -93,6 +130,10 @@ class SplayDict {
     
     Node* findNode(Node* subtree, const K& key) const; 
     
+    Node* lowerNode(const K& key) const;
+    
+    Node* upperNode(const K& key) const;
+    
     bool hasGrandParent(Node* subtree) const;
     
     void rightRotate(Node* n);
@@ -115,11 +156,23 @@ class SplayDict {
     
     void erase_node(Node* node);
     
+    typedef typename std::allocator_traits<A>::template rebind_alloc<Node> NodeAllocator;
+    typedef std::allocator_traits<NodeAllocator> NodeTraits;
+
+    Node* create_node(Node* parent, const K& key, const V& val);
+    
+    template<typename ForwardIt>
+    Node* buildSorted(ForwardIt& it, size_t n, Node* parent);
+
+    void destroy_node(Node* node);
+
     Node* root;
+
+    NodeAllocator node_alloc;
     
   friend class ConstIterator;
   
-  friend std::ostream& operator<< (std::ostream& os, const SplayDict<K,V>& spDict){
+  friend std::ostream& operator<< (std::ostream& os, const SplayDict<K, V, A>& spDict){
     printNode(os, spDict.root, "", true);
     return os;
   }
@@ -127,13 +180,24 @@ class SplayDict {
 };
 
 
-template<typename K, typename V> 
-SplayDict<K, V>::SplayDict() {
+template<typename K, typename V, typename A> 
+SplayDict<K, V, A>::SplayDict() {
     root = nullptr;
 }
 
-template<typename K, typename V> 
-SplayDict<K, V>::~SplayDict() {
+template<typename K, typename V, typename A> 
+SplayDict<K, V, A>::SplayDict(const A& alloc): node_alloc(alloc) {
+    root = nullptr;
+}
+
+template<typename K, typename V, typename A> 
+SplayDict<K, V, A>::~SplayDict() {
+  // nodes that need no destructor are left to an allocator that frees
+  // them in bulk, e.g. a PoolAllocator that no one else uses
+  if (std::is_trivially_destructible<Node>::value and internal::releases_in_bulk(node_alloc)) {
+    return;
+  }
+
   std::stack<Node*> nodes;
   nodes.push(root);
   
@@ -145,58 +209,173 @@ SplayDict<K, V>::~SplayDict() {
       nodes.push(current->left);
       nodes.push(current->right);
 
-      delete current;
+      destroy_node(current);
     }
     
   }
 }
 
-template<typename K, typename V> 
-SplayDict<K, V>::SplayDict(const SplayDict& bst) {
+template<typename K, typename V, typename A> 
+SplayDict<K, V, A>::SplayDict(const SplayDict& bst):
+                node_alloc(NodeTraits::select_on_container_copy_construction(bst.node_alloc)) {
+  root = nullptr;
   for (ConstIterator it = bst.begin(); it != bst.end(); it++) {
     set( (*it).first, (*it).second);
   }
 }
 
-template<typename K, typename V> 
-bool SplayDict<K, V>::exists(const K& key) const {
+template<typename K, typename V, typename A> 
+SplayDict<K, V, A>::SplayDict(SplayDict&& bst): node_alloc(bst.node_alloc) {
+  root = bst.root;
+  bst.root = nullptr;
+}
+
+template<typename K, typename V, typename A> 
+template<typename ForwardIt>
+SplayDict<K, V, A> SplayDict<K, V, A>::from_sorted(ForwardIt first, ForwardIt last, const A& alloc) {
+  size_t n = 0;
+  for (ForwardIt it = first, prev = first; it != last; prev = it++, n++) {
+    assert(n == 0 or (*prev).first < (*it).first);
+  }
+  
+  SplayDict dict(alloc);
+  dict.root = dict.buildSorted(first, n, nullptr);
+  return dict;
+}
+
+template<typename K, typename V, typename A> 
+template<typename Range>
+SplayDict<K, V, A> SplayDict<K, V, A>::from_sorted(const Range& range, const A& alloc) {
+  return from_sorted(range.begin(), range.end(), alloc);
+}
+
+// Builds the n entries from it on in order: the lower half into the left
+// subtree, then the middle one, then the upper half. The halves differ by
+// one entry at most, and so do the heights of the subtrees.
+template<typename K, typename V, typename A> 
+template<typename ForwardIt>
+typename SplayDict<K, V, A>::Node* SplayDict<K, V, A>::buildSorted(ForwardIt& it, size_t n, Node* parent) {
+  if (n == 0) {
+    return nullptr;
+  }
+  
+  Node* left = buildSorted(it, n / 2, nullptr);
+  Node* node = create_node(parent, (*it).first, (*it).second);
+  ++it;
+  
+  node->left = left;
+  if (left != nullptr) {
+    left->parent = node;
+  }
+  node->right = buildSorted(it, n - n / 2 - 1, node);
+  return node;
+}
+
+template<typename K, typename V, typename A> 
+typename SplayDict<K, V, A>::Node* SplayDict<K, V, A>::create_node(Node* parent, const K& key, const V& val) {
+  Node* node = NodeTraits::allocate(node_alloc, 1);
+  NodeTraits::construct(node_alloc, node, parent, key, val);
+  return node;
+}
+
+template<typename K, typename V, typename A> 
+void SplayDict<K, V, A>::destroy_node(Node* node) {
+  NodeTraits::destroy(node_alloc, node);
+  NodeTraits::deallocate(node_alloc, node, 1);
+}
+
+template<typename K, typename V, typename A> 
+bool SplayDict<K, V, A>::exists(const K& key) const {
   return findNode(root, key) != nullptr;
 }
 
-template<typename K, typename V> 
-V& SplayDict<K, V>::get(const K& key){
+template<typename K, typename V, typename A> 
+V& SplayDict<K, V, A>::get(const K& key){
   Node* node = findNode(root, key);
   root = splay(node);  
   return root->val;
 }
 
-template<typename K, typename V> 
-void SplayDict<K, V>::set(const K& key, const V& val) {
+template<typename K, typename V, typename A> 
+void SplayDict<K, V, A>::set(const K& key, const V& val) {
   set(root, nullptr, key, val);
 }
 
-template<typename K, typename V> 
-void SplayDict<K, V>::erase(const K& key){
+template<typename K, typename V, typename A> 
+void SplayDict<K, V, A>::erase(const K& key){
   Node* node = findNode(root, key);
   
   erase_node(node);
 }
 
-template<typename K, typename V> 
-typename SplayDict<K,V>::ConstIterator SplayDict<K, V>::begin(){
+template<typename K, typename V, typename A> 
+typename SplayDict<K, V, A>::ConstIterator SplayDict<K, V, A>::begin(){
   ConstIterator it = ConstIterator(root);
   return it;
 }
 
-template<typename K, typename V> 
-typename SplayDict<K,V>::ConstIterator SplayDict<K, V>::end(){
+template<typename K, typename V, typename A> 
+typename SplayDict<K, V, A>::ConstIterator SplayDict<K, V, A>::end(){
   ConstIterator it = ConstIterator(nullptr, root);
   return it;
 }
 
+template<typename K, typename V, typename A> 
+typename SplayDict<K, V, A>::ConstIterator SplayDict<K, V, A>::lower_bound(const K& key){
+  Node* node = lowerNode(key);
+  if (node != nullptr) {
+    root = splay(node);
+  }
+  return ConstIterator(node, node == nullptr ? root : node->left);
+}
+
+template<typename K, typename V, typename A> 
+typename SplayDict<K, V, A>::ConstIterator SplayDict<K, V, A>::upper_bound(const K& key){
+  Node* node = upperNode(key);
+  if (node != nullptr) {
+    root = splay(node);
+  }
+  return ConstIterator(node, node == nullptr ? root : node->left);
+}
+
+template<typename K, typename V, typename A> 
+std::pair<typename SplayDict<K, V, A>::ConstIterator, typename SplayDict<K, V, A>::ConstIterator> SplayDict<K, V, A>::equal_range(const K& key){
+  ConstIterator first = lower_bound(key);
+  return std::make_pair(first, upper_bound(key));
+}
+
+template<typename K, typename V, typename A> 
+template<typename F>
+void SplayDict<K, V, A>::for_each_in_range(const K& lo, const K& hi, F fn){
+  // the first entry goes up to the root, as in get()
+  Node* first = lowerNode(lo);
+  if (first == nullptr) {
+    return;
+  }
+  root = splay(first);
+  
+  // the nodes still to visit, one per level at most. The root is the
+  // first entry and its left subtree is all below lo, so the scan starts
+  // at the root alone.
+  std::vector<Node*> pending;
+  pending.reserve(64);
+  pending.push_back(root);
+  
+  while (!pending.empty()) {
+    Node* node = pending.back();
+    pending.pop_back();
+    if (!(node->key < hi) or !fn(node->key, node->val)) {
+      return;
+    }
+    for (Node* child = node->right; child != nullptr; child = child->left) {
+      pending.push_back(child);
+    }
+  }
+}
+
 
-template<typename K, typename V> 
-typename SplayDict<K, V>::Node* SplayDict<K, V>::findNode(Node* subtree, const K& key) const{
+template<typename K, typename V, typename A> 
+typename SplayDict<K, V, A>::Node* SplayDict<K, V, A>::findNode(Node* subtree, const K& key) const{
   if (subtree == nullptr){
     return nullptr;
   }
@@ -211,12 +390,42 @@ typename SplayDict<K, V>::Node* SplayDict<K, V>::findNode(Node* subtree, const K
   }  
 }
 
+template<typename K, typename V, typename A> 
+typename SplayDict<K, V, A>::Node* SplayDict<K, V, A>::lowerNode(const K& key) const{
+  Node* bound = nullptr;
+  Node* node = root;
+  while (node != nullptr) {
+    if (node->key < key) {
+      node = node->right;
+    } else {
+      bound = node;
+      node = node->left;
+    }
+  }
+  return bound;
+}
+
+template<typename K, typename V, typename A> 
+typename SplayDict<K, V, A>::Node* SplayDict<K, V, A>::upperNode(const K& key) const{
+  Node* bound = nullptr;
+  Node* node = root;
+  while (node != nullptr) {
+    if (key < node->key) {
+      bound = node;
+      node = node->left;
+    } else {
+      node = node->right;
+    }
+  }
+  return bound;
+}
+
 
-template<typename K, typename V> 
-void SplayDict<K, V>::set(Node*& subtree, Node* parent, const K& key, const V& val){
+template<typename K, typename V, typename A> 
+void SplayDict<K, V, A>::set(Node*& subtree, Node* parent, const K& key, const V& val){
   if (subtree == nullptr) {
     // by using the reference to pointer, we update parent's pointer 
-    subtree = new Node(parent, key, val);
+    subtree = create_node(parent, key, val);
     root = splay(subtree);
   }
   else if (subtree->key == key) {
@@ -232,8 +441,8 @@ void SplayDict<K, V>::set(Node*& subtree, Node* parent, const K& key, const V& v
   }
 }
 
-template<typename K, typename V> 
-typename SplayDict<K,V>::Node* SplayDict<K, V>::subtreeMaxKey(Node* subtree, Node* parent){
+template<typename K, typename V, typename A> 
+typename SplayDict<K, V, A>::Node* SplayDict<K, V, A>::subtreeMaxKey(Node* subtree, Node* parent){
   if (subtree == nullptr){
     return parent;
   }
@@ -243,18 +452,18 @@ typename SplayDict<K,V>::Node* SplayDict<K, V>::subtreeMaxKey(Node* subtree, Nod
 }
 
 
-template<typename K, typename V> 
-typename SplayDict<K,V>::Node* SplayDict<K, V>::subtreeMin(Node* subtree){
+template<typename K, typename V, typename A> 
+typename SplayDict<K, V, A>::Node* SplayDict<K, V, A>::subtreeMin(Node* subtree){
   return subtreeMinKey(subtree->left, subtree);
 }
 
-template<typename K, typename V> 
-typename SplayDict<K,V>::Node* SplayDict<K, V>::subtreeMax(Node* subtree){
+template<typename K, typename V, typename A> 
+typename SplayDict<K, V, A>::Node* SplayDict<K, V, A>::subtreeMax(Node* subtree){
   return subtreeMaxKey(subtree->right, subtree);
 }
 
-template<typename K, typename V> 
-typename SplayDict<K,V>::Node* SplayDict<K, V>::subtreeMinKey(Node* subtree, Node* parent){
+template<typename K, typename V, typename A> 
+typename SplayDict<K, V, A>::Node* SplayDict<K, V, A>::subtreeMinKey(Node* subtree, Node* parent){
   if (subtree == nullptr){
     return parent;
   }
@@ -263,8 +472,8 @@ typename SplayDict<K,V>::Node* SplayDict<K, V>::subtreeMinKey(Node* subtree, Nod
   }
 }
 
-template<typename K, typename V> 
-void SplayDict<K, V>::erase_node(Node* node){
+template<typename K, typename V, typename A> 
+void SplayDict<K, V, A>::erase_node(Node* node){
   
   splay(node);
   
@@ -276,7 +485,7 @@ void SplayDict<K, V>::erase_node(Node* node){
     if(right_subtree != nullptr){
 		right_subtree->parent = nullptr;
 	}
-    delete node;
+    destroy_node(node);
     
     Node* max_left = subtreeMax(left_subtree);
     
@@ -293,7 +502,7 @@ void SplayDict<K, V>::erase_node(Node* node){
     if(right_subtree != nullptr){
 		right_subtree->parent = nullptr;
 	}
-    delete node;
+    destroy_node(node);
     
     root = right_subtree;
   }
@@ -301,34 +510,35 @@ void SplayDict<K, V>::erase_node(Node* node){
   
 }
 
-template<typename K, typename V> 
-const std::pair<K&, V&> SplayDict<K, V>::ConstIterator::operator*() const {
+template<typename K, typename V, typename A> 
+const std::pair<K&, V&> SplayDict<K, V, A>::ConstIterator::operator*() const {
   std::pair<K&, V&> res {current->key, current->val};
   return res;
 }
 
 
-template<typename K, typename V> 
-typename SplayDict<K,V>::ConstIterator& SplayDict<K, V>::ConstIterator::operator=(const ConstIterator& it) {
+template<typename K, typename V, typename A> 
+typename SplayDict<K, V, A>::ConstIterator& SplayDict<K, V, A>::ConstIterator::operator=(const ConstIterator& it) {
   current = it.current;
   prev = it.prev;
   
   return *this;
 }
 
-template<typename K, typename V> 
-bool SplayDict<K, V>::ConstIterator::operator==(const ConstIterator& it) const {
-  return (current == it.current and prev == it.prev);
+template<typename K, typename V, typename A> 
+bool SplayDict<K, V, A>::ConstIterator::operator==(const ConstIterator& it) const {
+  // prev depends on the way current was reached
+  return current == it.current;
 }
 
-template<typename K, typename V> 
-bool SplayDict<K, V>::ConstIterator::operator!=(const ConstIterator& it) const {
+template<typename K, typename V, typename A> 
+bool SplayDict<K, V, A>::ConstIterator::operator!=(const ConstIterator& it) const {
   return !(*this == it);
 }
 
 
-template<typename K, typename V> 
-typename SplayDict<K,V>::ConstIterator& SplayDict<K, V>::ConstIterator::operator++(int) {
+template<typename K, typename V, typename A> 
+typename SplayDict<K, V, A>::ConstIterator& SplayDict<K, V, A>::ConstIterator::operator++(int) {
   if (prev != nullptr and prev->left == current) {
     if (current->right != nullptr){
       current = subtreeMin(current->right);
@@ -367,8 +577,8 @@ typename SplayDict<K,V>::ConstIterator& SplayDict<K, V>::ConstIterator::operator
   return *this;
 }
 
-template<typename K, typename V>
-bool SplayDict<K, V>::sideOfChild(Node* subtree, bool zag1, bool zag2) const {
+template<typename K, typename V, typename A>
+bool SplayDict<K, V, A>::sideOfChild(Node* subtree, bool zag1, bool zag2) const {
   Node* grand_parent = subtree->parent->parent;
   Node* possible_parent;
   if (zag1 == false) {
@@ -393,16 +603,16 @@ bool SplayDict<K, V>::sideOfChild(Node* subtree, bool zag1, bool zag2) const {
   return possible_child == subtree; 
 }
 
-template<typename K, typename V>
-bool SplayDict<K, V>::hasGrandParent(Node* subtree) const {
+template<typename K, typename V, typename A>
+bool SplayDict<K, V, A>::hasGrandParent(Node* subtree) const {
   if (subtree->parent == nullptr) {
     return false;
   }
   return subtree->parent->parent != nullptr;
 }
 
-template<typename K, typename V>
-void SplayDict<K, V>::rightRotate(Node* n) {
+template<typename K, typename V, typename A>
+void SplayDict<K, V, A>::rightRotate(Node* n) {
   Node* new_root = n->left;
   
   n->left = new_root->right;
@@ -425,8 +635,8 @@ void SplayDict<K, V>::rightRotate(Node* n) {
   }
 }
 
-template<typename K, typename V>
-void SplayDict<K, V>::leftRotate(Node* n) {
+template<typename K, typename V, typename A>
+void SplayDict<K, V, A>::leftRotate(Node* n) {
   Node* new_root = n->right;
   
   n->right = new_root->left;
@@ -449,8 +659,8 @@ void SplayDict<K, V>::leftRotate(Node* n) {
   }
 }
 
-template<typename K, typename V>
-typename SplayDict<K,V>::Node* SplayDict<K, V>::splay(Node* subtree){
+template<typename K, typename V, typename A>
+typename SplayDict<K, V, A>::Node* SplayDict<K, V, A>::splay(Node* subtree){
   while(hasGrandParent(subtree)) {
     if (sideOfChild(subtree, false, false)) {
       // Zig Zig
@@ -489,8 +699,8 @@ typename SplayDict<K,V>::Node* SplayDict<K, V>::splay(Node* subtree){
   
 }
 
-template<typename K, typename V>
-void SplayDict<K,V>::printNode(std::ostream& os, Node* node, std::string prefix, bool isTail){
+template<typename K, typename V, typename A>
+void SplayDict<K, V, A>::printNode(std::ostream& os, Node* node, std::string prefix, bool isTail){
     if (node == nullptr){
       return;
     }